@@ -0,0 +1,95 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "AsyncCrypt.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cryptex
+{
+
+    namespace
+    {
+        Task<void> writeAll(IAsyncIO &io, int const fd, std::string const &data)
+        {
+            std::size_t written = 0;
+            while (written < data.size()) {
+                written += co_await io.write(fd, data.data() + written, data.size() - written);
+            }
+        }
+    }
+
+    Task<unsigned long> asyncCrypt(IAsyncIO &io,
+                                   int const inFd,
+                                   int const outFd,
+                                   boost::shared_ptr<IEncryptor> enc,
+                                   std::size_t const sliceBytes)
+    {
+        if (sliceBytes == 0) {
+            throw std::invalid_argument("cryptex: asyncCrypt needs a slice of at least 1 byte");
+        }
+        std::vector<unsigned char> slice(sliceBytes);
+        std::ostringstream out;
+        unsigned long total = 0;
+
+        //
+        // the last byte has to be flagged as such (e.g. XTEADecryptor recovers
+        // the data length from the last block), so each byte is held back
+        // until it is known whether another one follows it
+        //
+        bool holding = false;
+        unsigned char held = 0;
+
+        while (true) {
+            std::size_t const got = co_await io.read(inFd, &slice.front(), slice.size());
+            if (got == 0) {
+                break;
+            }
+            total += got;
+
+            for (std::size_t i = 0; i < got; ++i) {
+                if (holding) {
+                    enc->encrypt(held, out, false);
+                }
+                held = slice[i];
+                holding = true;
+            }
+
+            co_await writeAll(io, outFd, out.str());
+            out.str(std::string());
+
+            // give other coroutines a turn before the next slice
+            co_await io.yield();
+        }
+
+        if (holding) {
+            enc->encrypt(held, out, true);
+            enc->finish(out);
+        }
+        co_await writeAll(io, outFd, out.str());
+        co_return total;
+    }
+
+}
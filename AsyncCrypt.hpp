@@ -0,0 +1,59 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef ASYNC_CRYPT_HPP__
+#define ASYNC_CRYPT_HPP__
+
+#include "AsyncIO.hpp"
+#include "IEncryptor.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+
+namespace cryptex
+{
+
+    /**
+     * @brief encrypts (or decrypts, depending on the IEncryptor) everything
+     * read from one descriptor and writes the result to another, suspending
+     * on the backend whilst waiting for I/O. Unlike an EncryptionSink, the
+     * length of the input doesn't need to be known up front.
+     * @param io the backend that reads and writes are carried out on
+     * @param inFd where the data is read from, until end of file
+     * @param outFd where the transformed data is written to
+     * @param enc implements an encryption algorithm (see IEncryptor)
+     * @param sliceBytes at most this many bytes are put through the cipher
+     * before the coroutine yields to the backend, so that other coroutines
+     * aren't starved
+     * @return the number of bytes read from inFd
+     * @note the task throws std::invalid_argument if sliceBytes is 0
+     */
+    Task<unsigned long> asyncCrypt(IAsyncIO &io,
+                                   int const inFd,
+                                   int const outFd,
+                                   boost::shared_ptr<IEncryptor> enc,
+                                   std::size_t const sliceBytes = 64 * 1024);
+
+}
+
+#endif // ASYNC_CRYPT_HPP__
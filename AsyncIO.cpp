@@ -0,0 +1,338 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "AsyncIO.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace cryptex
+{
+
+    namespace
+    {
+        void throwSystemError(char const *what, int const error)
+        {
+            throw std::runtime_error(std::string("cryptex: ") + what + ": " + std::strerror(error));
+        }
+
+        ssize_t transfer(IOOperation const &op)
+        {
+            ssize_t result;
+            do {
+                if (op.kind == IOOperation::READ) {
+                    result = ::read(op.fd, op.buffer, op.bytes);
+                } else {
+                    result = ::write(op.fd, op.buffer, op.bytes);
+                }
+            } while (result < 0 && errno == EINTR);
+            return result;
+        }
+    }
+
+    IOAwaitable::IOAwaitable(IAsyncIO &io, IOOperation::Kind const kind, int const fd,
+                             void * const buffer, std::size_t const bytes)
+        : m_io(io)
+    {
+        m_op.kind = kind;
+        m_op.fd = fd;
+        m_op.buffer = buffer;
+        m_op.bytes = bytes;
+        m_op.result = 0;
+        m_op.error = 0;
+    }
+
+    void
+    IOAwaitable::await_suspend(std::coroutine_handle<> const waiting)
+    {
+        m_op.waiting = waiting;
+        m_io.submit(m_op);
+    }
+
+    std::size_t
+    IOAwaitable::await_resume() const
+    {
+        if (m_op.result < 0) {
+            throwSystemError(m_op.kind == IOOperation::READ ? "read failed" : "write failed", m_op.error);
+        }
+        return static_cast<std::size_t>(m_op.result);
+    }
+
+    void
+    YieldAwaitable::await_suspend(std::coroutine_handle<> const waiting)
+    {
+        m_io.post(waiting);
+    }
+
+    IOAwaitable
+    IAsyncIO::read(int const fd, void * const buffer, std::size_t const bytes)
+    {
+        return IOAwaitable(*this, IOOperation::READ, fd, buffer, bytes);
+    }
+
+    IOAwaitable
+    IAsyncIO::write(int const fd, void const * const buffer, std::size_t const bytes)
+    {
+        return IOAwaitable(*this, IOOperation::WRITE, fd, const_cast<void*>(buffer), bytes);
+    }
+
+    YieldAwaitable
+    IAsyncIO::yield()
+    {
+        return YieldAwaitable(*this);
+    }
+
+    IAsyncIO::~IAsyncIO()
+    {
+    }
+
+    ThreadPoolAsyncIO::ThreadPoolAsyncIO(unsigned int const threads)
+        : m_stopping(false)
+    {
+        for (unsigned int i = 0; i < threads; ++i) {
+            m_threads.push_back(std::thread(&ThreadPoolAsyncIO::work, this));
+        }
+    }
+
+    void
+    ThreadPoolAsyncIO::submit(IOOperation &op)
+    {
+        IOOperation *pending = &op;
+        enqueue([pending]() {
+            ssize_t const result = transfer(*pending);
+            pending->error = result < 0 ? errno : 0;
+            pending->result = result;
+            pending->waiting.resume();
+        });
+    }
+
+    void
+    ThreadPoolAsyncIO::post(std::coroutine_handle<> const handle)
+    {
+        enqueue([handle]() { handle.resume(); });
+    }
+
+    void
+    ThreadPoolAsyncIO::run(std::atomic<bool> const &done)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneChanged.wait(lock, [&done]() { return done.load(); });
+    }
+
+    void
+    ThreadPoolAsyncIO::complete(std::atomic<bool> &done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            done = true;
+        }
+        m_doneChanged.notify_all();
+    }
+
+    void
+    ThreadPoolAsyncIO::enqueue(std::function<void ()> const &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(job);
+        }
+        m_jobAvailable.notify_one();
+    }
+
+    void
+    ThreadPoolAsyncIO::work()
+    {
+        while (true) {
+            std::function<void ()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                job = m_jobs.front();
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    ThreadPoolAsyncIO::~ThreadPoolAsyncIO()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobAvailable.notify_all();
+        for (std::size_t i = 0; i < m_threads.size(); ++i) {
+            m_threads[i].join();
+        }
+    }
+
+    EpollAsyncIO::EpollAsyncIO()
+        : m_epoll(::epoll_create1(EPOLL_CLOEXEC))
+    {
+        if (m_epoll < 0) {
+            throwSystemError("epoll_create1 failed", errno);
+        }
+    }
+
+    void
+    EpollAsyncIO::submit(IOOperation &op)
+    {
+        //
+        // the descriptor will often be ready already, in which case there
+        // is no need to go through epoll at all
+        //
+        if (attempt(op)) {
+            m_ready.push_back(op.waiting);
+            return;
+        }
+        Waiting &waiting = m_waiting[op.fd];
+        if (op.kind == IOOperation::READ) {
+            waiting.reader = &op;
+        } else {
+            waiting.writer = &op;
+        }
+        updateInterest(op.fd);
+    }
+
+    void
+    EpollAsyncIO::post(std::coroutine_handle<> const handle)
+    {
+        m_ready.push_back(handle);
+    }
+
+    void
+    EpollAsyncIO::run(std::atomic<bool> const &done)
+    {
+        while (!done) {
+            while (!m_ready.empty() && !done) {
+                std::coroutine_handle<> const handle = m_ready.front();
+                m_ready.pop_front();
+                handle.resume();
+            }
+            if (done) {
+                break;
+            }
+            if (m_waiting.empty()) {
+                throw std::runtime_error("cryptex: nothing left to wait for but not done");
+            }
+
+            epoll_event events[16];
+            int ready;
+            do {
+                ready = ::epoll_wait(m_epoll, events, 16, -1);
+            } while (ready < 0 && errno == EINTR);
+            if (ready < 0) {
+                throwSystemError("epoll_wait failed", errno);
+            }
+
+            for (int i = 0; i < ready; ++i) {
+                int const fd = events[i].data.fd;
+                Waiting &waiting = m_waiting[fd];
+                if (waiting.reader && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                    if (attempt(*waiting.reader)) {
+                        m_ready.push_back(waiting.reader->waiting);
+                        waiting.reader = 0;
+                    }
+                }
+                if (waiting.writer && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                    if (attempt(*waiting.writer)) {
+                        m_ready.push_back(waiting.writer->waiting);
+                        waiting.writer = 0;
+                    }
+                }
+                updateInterest(fd);
+            }
+        }
+    }
+
+    void
+    EpollAsyncIO::complete(std::atomic<bool> &done)
+    {
+        done = true;
+    }
+
+    bool
+    EpollAsyncIO::attempt(IOOperation &op)
+    {
+        //
+        // the non-blocking flag belongs to the open file rather than the
+        // descriptor, so it is shared with anyone else using the file (e.g.
+        // a shell, for stdin and stdout). It is therefore only set for as
+        // long as the transfer takes and then put back as it was
+        //
+        int const flags = ::fcntl(op.fd, F_GETFL);
+        bool const switched = flags >= 0 && !(flags & O_NONBLOCK);
+        if (switched) {
+            ::fcntl(op.fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        ssize_t const result = transfer(op);
+        int const error = result < 0 ? errno : 0;
+        if (switched) {
+            ::fcntl(op.fd, F_SETFL, flags);
+        }
+
+        if (result < 0 && (error == EAGAIN || error == EWOULDBLOCK)) {
+            return false;
+        }
+        op.error = error;
+        op.result = result;
+        return true;
+    }
+
+    void
+    EpollAsyncIO::updateInterest(int const fd)
+    {
+        Waiting &waiting = m_waiting[fd];
+        uint32_t const events = (waiting.reader ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+                                (waiting.writer ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        if (events == 0) {
+            if (waiting.registered) {
+                ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, 0);
+            }
+            m_waiting.erase(fd);
+            return;
+        }
+
+        epoll_event event;
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(m_epoll, waiting.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) != 0) {
+            throwSystemError("epoll_ctl failed", errno);
+        }
+        waiting.registered = true;
+    }
+
+    EpollAsyncIO::~EpollAsyncIO()
+    {
+        ::close(m_epoll);
+    }
+
+}
@@ -0,0 +1,432 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef ASYNC_IO_HPP__
+#define ASYNC_IO_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace cryptex
+{
+
+    template <typename T> class Task;
+
+    namespace detail
+    {
+
+        // the parts of a Task's promise that don't depend on its result type
+        struct TaskPromiseBase
+        {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            // on completion, carry on with whoever was awaiting the task
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept { return false; }
+
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    std::coroutine_handle<> const continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        template <typename T>
+        struct TaskPromise : TaskPromiseBase
+        {
+            std::optional<T> value;
+            Task<T> get_return_object();
+            void return_value(T v) { value.emplace(std::move(v)); }
+            T result()
+            {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct TaskPromise<void> : TaskPromiseBase
+        {
+            Task<void> get_return_object();
+            void return_void() {}
+            void result()
+            {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        };
+
+    }
+
+    /**
+     * @brief a lazily started coroutine producing a T. It starts running
+     * when it is co_awaited, and the awaiting coroutine carries on when it
+     * completes
+     */
+    template <typename T>
+    class Task
+    {
+
+      public:
+        typedef detail::TaskPromise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        explicit Task(Handle const handle) : m_handle(handle) {}
+        Task(Task &&other) : m_handle(std::exchange(other.m_handle, Handle())) {}
+        Task(Task const &) = delete;
+        Task &operator=(Task const &) = delete;
+
+        ~Task()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> const awaiting) noexcept
+        {
+            m_handle.promise().continuation = awaiting;
+            return m_handle;
+        }
+
+        T await_resume() { return m_handle.promise().result(); }
+
+      private:
+        Handle m_handle;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        Task<T> TaskPromise<T>::get_return_object()
+        {
+            return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+        }
+
+        inline Task<void> TaskPromise<void>::get_return_object()
+        {
+            return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+        }
+    }
+
+    class IAsyncIO;
+
+    /**
+     * @brief a read or write which suspends the awaiting coroutine until
+     * the backend has carried it out
+     */
+    struct IOOperation
+    {
+        enum Kind { READ, WRITE };
+
+        Kind kind;
+        int fd;
+        void *buffer;
+        std::size_t bytes;
+
+        // set by the backend before resuming the coroutine; result is the
+        // return value of read or write and error the errno if that failed
+        ssize_t result;
+        int error;
+        std::coroutine_handle<> waiting;
+    };
+
+    class IOAwaitable
+    {
+
+      public:
+        IOAwaitable(IAsyncIO &io, IOOperation::Kind const kind, int const fd,
+                    void * const buffer, std::size_t const bytes);
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> const waiting);
+
+        /**
+         * @return the number of bytes read (0 at end of file) or written
+         * @note throws std::runtime_error if the read or write failed
+         */
+        std::size_t await_resume() const;
+
+      private:
+        IAsyncIO &m_io;
+        IOOperation m_op;
+    };
+
+    class YieldAwaitable
+    {
+
+      public:
+        explicit YieldAwaitable(IAsyncIO &io) : m_io(io) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> const waiting);
+        void await_resume() const noexcept {}
+
+      private:
+        IAsyncIO &m_io;
+    };
+
+    /**
+     * @brief the interface of an asynchronous I/O backend which coroutines
+     * suspend on whilst reading or writing file descriptors
+     */
+    class IAsyncIO
+    {
+
+      public:
+
+        /**
+         * @return awaitables that read in to or write from buffer. They
+         * complete with the number of bytes transferred, which may be fewer
+         * than were asked for
+         */
+        IOAwaitable read(int const fd, void * const buffer, std::size_t const bytes);
+        IOAwaitable write(int const fd, void const * const buffer, std::size_t const bytes);
+
+        /**
+         * @return an awaitable that reschedules the awaiting coroutine behind
+         * whatever else the backend has to do, so that long running work
+         * can be split in to slices
+         */
+        YieldAwaitable yield();
+
+        /**
+         * @brief carries out op and then resumes op.waiting
+         */
+        virtual void submit(IOOperation &op) = 0;
+
+        /**
+         * @brief resumes a coroutine as soon as the backend gets the chance
+         */
+        virtual void post(std::coroutine_handle<> const handle) = 0;
+
+        /**
+         * @brief runs (or waits for) the backend until done is set by complete
+         */
+        virtual void run(std::atomic<bool> const &done) = 0;
+
+        /**
+         * @brief sets done, waking up run
+         */
+        virtual void complete(std::atomic<bool> &done) = 0;
+
+        virtual ~IAsyncIO();
+    };
+
+    /**
+     * @brief a backend which carries out (blocking) reads and writes on a
+     * pool of threads, resuming the coroutines on those threads
+     */
+    class ThreadPoolAsyncIO : public IAsyncIO
+    {
+
+      public:
+        explicit ThreadPoolAsyncIO(unsigned int const threads = 2);
+        ~ThreadPoolAsyncIO();
+
+      private:
+        ThreadPoolAsyncIO(ThreadPoolAsyncIO const &); // no impl required
+        ThreadPoolAsyncIO &operator=(ThreadPoolAsyncIO const &); // no impl required
+
+        void submit(IOOperation &op);
+        void post(std::coroutine_handle<> const handle);
+        void run(std::atomic<bool> const &done);
+        void complete(std::atomic<bool> &done);
+
+        void enqueue(std::function<void ()> const &job);
+        void work();
+
+        std::mutex m_mutex;
+        std::condition_variable m_jobAvailable;
+        std::condition_variable m_doneChanged;
+        std::deque<std::function<void ()> > m_jobs;
+        bool m_stopping;
+        std::vector<std::thread> m_threads;
+    };
+
+    /**
+     * @brief a single threaded backend built around an epoll loop. The loop
+     * runs in whichever thread calls run (e.g. through syncWait), and that
+     * is where coroutines are resumed.
+     * @note descriptors passed to it are switched to non-blocking mode only
+     * whilst each read or write is attempted, and otherwise left as they
+     * were. Descriptors that epoll doesn't support, such as regular files,
+     * are read and written directly
+     */
+    class EpollAsyncIO : public IAsyncIO
+    {
+
+      public:
+        EpollAsyncIO();
+        ~EpollAsyncIO();
+
+      private:
+        EpollAsyncIO(EpollAsyncIO const &); // no impl required
+        EpollAsyncIO &operator=(EpollAsyncIO const &); // no impl required
+
+        void submit(IOOperation &op);
+        void post(std::coroutine_handle<> const handle);
+        void run(std::atomic<bool> const &done);
+        void complete(std::atomic<bool> &done);
+
+        // the operations waiting on a descriptor to become ready
+        struct Waiting
+        {
+            IOOperation *reader;
+            IOOperation *writer;
+            bool registered;
+        };
+
+        bool attempt(IOOperation &op);
+        void updateInterest(int const fd);
+
+        int const m_epoll;
+        std::deque<std::coroutine_handle<> > m_ready;
+        std::map<int, Waiting> m_waiting;
+    };
+
+    namespace detail
+    {
+
+        // the coroutine through which syncWait awaits a task. It signals the
+        // backend once it has suspended for the last time, at which point
+        // it is safe for syncWait to destroy it
+        struct SyncWaitTask
+        {
+            struct promise_type
+            {
+                IAsyncIO *io;
+                std::atomic<bool> *done;
+
+                SyncWaitTask get_return_object()
+                {
+                    return SyncWaitTask(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+
+                std::suspend_always initial_suspend() noexcept { return {}; }
+
+                struct FinalAwaiter
+                {
+                    bool await_ready() noexcept { return false; }
+                    void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                    {
+                        IAsyncIO &io = *handle.promise().io;
+                        std::atomic<bool> &done = *handle.promise().done;
+                        io.complete(done);
+                    }
+                    void await_resume() noexcept {}
+                };
+
+                FinalAwaiter final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+
+            explicit SyncWaitTask(std::coroutine_handle<promise_type> const handle) : handle(handle) {}
+            SyncWaitTask(SyncWaitTask const &) = delete;
+            ~SyncWaitTask() { handle.destroy(); }
+
+            std::coroutine_handle<promise_type> handle;
+        };
+
+        template <typename T>
+        SyncWaitTask awaitTask(Task<T> &task, std::optional<T> &value, std::exception_ptr &error)
+        {
+            try {
+                value.emplace(co_await task);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        inline SyncWaitTask awaitTask(Task<void> &task, std::optional<bool> &value, std::exception_ptr &error)
+        {
+            try {
+                co_await task;
+                value.emplace(true);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+    }
+
+    /**
+     * @brief runs a task on a backend, blocking until it has completed
+     * @return the task's result; if the task threw, the exception is rethrown
+     */
+    template <typename T>
+    T syncWait(IAsyncIO &io, Task<T> task)
+    {
+        typedef typename std::conditional<std::is_void<T>::value, bool, T>::type Value;
+        std::optional<Value> value;
+        std::exception_ptr error;
+        std::atomic<bool> done(false);
+
+        detail::SyncWaitTask waiter = detail::awaitTask(task, value, error);
+        waiter.handle.promise().io = &io;
+        waiter.handle.promise().done = &done;
+        io.post(waiter.handle);
+        io.run(done);
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if constexpr (!std::is_void<T>::value) {
+            return std::move(*value);
+        }
+    }
+
+}
+
+#endif // ASYNC_IO_HPP__
@@ -0,0 +1,303 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "BufferPool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+namespace cryptex
+{
+
+    namespace
+    {
+        std::size_t const CACHE_LINE = 64;
+        std::size_t const PAGE = 4096;
+        std::size_t const HUGE_PAGE = 2 * 1024 * 1024;
+
+        // how the shared pool is to be set up, and whether it has been
+        struct SharedPoolSettings
+        {
+            std::mutex mutex;
+            bool created;
+            std::size_t maxCachedBytes;
+            bool hugePages;
+
+            SharedPoolSettings()
+                : created(false)
+                , maxCachedBytes(64 * 1024 * 1024)
+                , hugePages(false)
+            {}
+        };
+
+        SharedPoolSettings &sharedPoolSettings()
+        {
+            static SharedPoolSettings settings;
+            return settings;
+        }
+
+        // huge page mappings are made in whole huge pages
+        std::size_t hugePageBytes(std::size_t const bytes)
+        {
+            return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        }
+    }
+
+    PooledBuffer::PooledBuffer()
+        : m_pool(0)
+        , m_data(0)
+        , m_size(0)
+    {}
+
+    PooledBuffer::PooledBuffer(BufferPool &pool, std::size_t const size)
+        : m_pool(&pool)
+        , m_data(pool.acquire(size))
+        , m_size(size)
+    {}
+
+    PooledBuffer::PooledBuffer(PooledBuffer const &other)
+        : m_pool(other.m_pool)
+        , m_data(other.m_pool ? other.m_pool->acquire(other.m_size) : 0)
+        , m_size(other.m_size)
+    {
+        if (m_data) {
+            std::memcpy(m_data, other.m_data, m_size);
+        }
+    }
+
+    PooledBuffer::PooledBuffer(PooledBuffer &&other)
+        : m_pool(other.m_pool)
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+    {
+        other.m_pool = 0;
+        other.m_data = 0;
+        other.m_size = 0;
+    }
+
+    PooledBuffer &
+    PooledBuffer::operator=(PooledBuffer other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void
+    PooledBuffer::swap(PooledBuffer &other)
+    {
+        std::swap(m_pool, other.m_pool);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+
+    PooledBuffer::~PooledBuffer()
+    {
+        if (m_data) {
+            m_pool->release(m_data, m_size);
+        }
+    }
+
+    BufferPool::BufferPool(std::size_t const maxCachedBytes, bool const hugePages)
+        : m_maxCachedBytes(maxCachedBytes)
+        , m_hugePages(hugePages)
+        , m_acquisitions(0)
+        , m_reuses(0)
+        , m_bytesInUse(0)
+        , m_peakBytesInUse(0)
+        , m_bytesCached(0)
+    {}
+
+    BufferPool &
+    BufferPool::shared()
+    {
+        //
+        // the shared pool is never destroyed, so that buffers held by static
+        // objects can still be handed back to it at exit
+        //
+        static BufferPool * const pool = []() {
+            SharedPoolSettings &settings = sharedPoolSettings();
+            std::lock_guard<std::mutex> lock(settings.mutex);
+            settings.created = true;
+            return new BufferPool(settings.maxCachedBytes, settings.hugePages);
+        }();
+        return *pool;
+    }
+
+    void
+    BufferPool::configureShared(std::size_t const maxCachedBytes, bool const hugePages)
+    {
+        SharedPoolSettings &settings = sharedPoolSettings();
+        std::lock_guard<std::mutex> lock(settings.mutex);
+        if (settings.created) {
+            throw std::logic_error("cryptex: the shared BufferPool is already in use");
+        }
+        settings.maxCachedBytes = maxCachedBytes;
+        settings.hugePages = hugePages;
+    }
+
+    PooledBuffer
+    BufferPool::borrow(std::size_t const size)
+    {
+        return PooledBuffer(*this, size);
+    }
+
+    BufferPool::Stats
+    BufferPool::stats() const
+    {
+        Stats stats;
+        stats.acquisitions = m_acquisitions;
+        stats.reuses = m_reuses;
+        stats.bytesInUse = m_bytesInUse;
+        stats.peakBytesInUse = m_peakBytesInUse;
+        stats.bytesCached = m_bytesCached;
+        return stats;
+    }
+
+    int
+    BufferPool::sizeClassFor(std::size_t const size)
+    {
+        int power = MIN_POWER;
+        while ((static_cast<std::size_t>(1) << power) < size) {
+            ++power;
+        }
+        if (power - MIN_POWER >= CLASSES / STEPS_PER_POWER) {
+            throw std::bad_alloc();
+        }
+
+        //
+        // sizes between 2^(power - 1) and 2^power go in to the smallest of
+        // the quarter steps between them that is big enough
+        //
+        if (power > MIN_POWER) {
+            std::size_t const below = static_cast<std::size_t>(1) << (power - 1);
+            std::size_t const step = below / STEPS_PER_POWER;
+            int const steps = static_cast<int>((size - below + step - 1) / step);
+            if (steps < STEPS_PER_POWER) {
+                return (power - 1 - MIN_POWER) * STEPS_PER_POWER + steps;
+            }
+        }
+        return (power - MIN_POWER) * STEPS_PER_POWER;
+    }
+
+    std::size_t
+    BufferPool::classBytes(int const sizeClass)
+    {
+        std::size_t const power = static_cast<std::size_t>(1) << (MIN_POWER + sizeClass / STEPS_PER_POWER);
+        return power + (sizeClass % STEPS_PER_POWER) * (power / STEPS_PER_POWER);
+    }
+
+    unsigned char *
+    BufferPool::acquire(std::size_t const size)
+    {
+        int const sizeClass = sizeClassFor(size);
+        std::size_t const bytes = classBytes(sizeClass);
+        ++m_acquisitions;
+
+        unsigned char *data = 0;
+        {
+            SizeClass &pooled = m_classes[sizeClass];
+            std::lock_guard<std::mutex> lock(pooled.mutex);
+            if (!pooled.free.empty()) {
+                data = pooled.free.back();
+                pooled.free.pop_back();
+            }
+        }
+        if (data) {
+            ++m_reuses;
+            m_bytesCached -= bytes;
+        } else {
+            data = allocate(bytes);
+        }
+
+        std::size_t const inUse = (m_bytesInUse += bytes);
+        std::size_t peak = m_peakBytesInUse;
+        while (inUse > peak && !m_peakBytesInUse.compare_exchange_weak(peak, inUse)) {}
+        return data;
+    }
+
+    void
+    BufferPool::release(unsigned char * const data, std::size_t const size)
+    {
+        int const sizeClass = sizeClassFor(size);
+        std::size_t const bytes = classBytes(sizeClass);
+        m_bytesInUse -= bytes;
+
+        if (m_bytesCached.fetch_add(bytes) + bytes > m_maxCachedBytes) {
+            m_bytesCached -= bytes;
+            deallocate(data, bytes);
+            return;
+        }
+        SizeClass &pooled = m_classes[sizeClass];
+        std::lock_guard<std::mutex> lock(pooled.mutex);
+        pooled.free.push_back(data);
+    }
+
+    unsigned char *
+    BufferPool::allocate(std::size_t const bytes) const
+    {
+        if (m_hugePages && bytes >= HUGE_PAGE) {
+            std::size_t const mapped = hugePageBytes(bytes);
+            void *data = ::mmap(0, mapped, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (data == MAP_FAILED) {
+                data = ::mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (data == MAP_FAILED) {
+                    throw std::bad_alloc();
+                }
+                ::madvise(data, mapped, MADV_HUGEPAGE);
+            }
+            return static_cast<unsigned char*>(data);
+        }
+
+        void *data = 0;
+        if (::posix_memalign(&data, bytes < PAGE ? CACHE_LINE : PAGE, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<unsigned char*>(data);
+    }
+
+    void
+    BufferPool::deallocate(unsigned char * const data, std::size_t const bytes) const
+    {
+        if (m_hugePages && bytes >= HUGE_PAGE) {
+            ::munmap(data, hugePageBytes(bytes));
+        } else {
+            std::free(data);
+        }
+    }
+
+    BufferPool::~BufferPool()
+    {
+        for (int i = 0; i < CLASSES; ++i) {
+            std::size_t const bytes = classBytes(i);
+            for (std::size_t j = 0; j < m_classes[i].free.size(); ++j) {
+                deallocate(m_classes[i].free[j], bytes);
+            }
+        }
+    }
+
+}
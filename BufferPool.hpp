@@ -0,0 +1,170 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef BUFFER_POOL_HPP__
+#define BUFFER_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace cryptex
+{
+
+    class BufferPool;
+
+    /**
+     * @brief a buffer borrowed from a BufferPool, which is handed back to
+     * the pool when the PooledBuffer is destroyed. Copying a PooledBuffer
+     * borrows another buffer of the same size and copies the contents in
+     * to it, so classes holding one keep their value semantics.
+     */
+    class PooledBuffer
+    {
+
+      public:
+        PooledBuffer();
+        PooledBuffer(BufferPool &pool, std::size_t const size);
+        PooledBuffer(PooledBuffer const &other);
+        PooledBuffer(PooledBuffer &&other);
+        PooledBuffer &operator=(PooledBuffer other);
+        ~PooledBuffer();
+
+        unsigned char *data() const { return m_data; }
+        std::size_t size() const { return m_size; }
+
+        void swap(PooledBuffer &other);
+
+      private:
+        BufferPool *m_pool;
+        unsigned char *m_data;
+        std::size_t m_size;
+    };
+
+    /**
+     * @brief a thread-safe pool of aligned buffers which cipher pipeline
+     * stages borrow their working storage from, rather than each allocating
+     * and freeing its own. Buffers are kept in size classes a quarter of a
+     * power of two apart, so that a buffer a little over a power of two (say
+     * a chunk plus a trailer) isn't rounded up to twice the size. Those
+     * smaller than a page are aligned to a cache line and the rest to a page.
+     * Optionally, buffers of 2 MiB or more are backed by huge pages.
+     */
+    class BufferPool
+    {
+
+      public:
+
+        struct Stats
+        {
+            // the number of buffers borrowed and how many of those were
+            // handed out again rather than newly allocated
+            unsigned long acquisitions;
+            unsigned long reuses;
+
+            // the bytes currently lent out and the most ever lent out at once
+            std::size_t bytesInUse;
+            std::size_t peakBytesInUse;
+
+            // the bytes held by the pool ready to be lent out again
+            std::size_t bytesCached;
+
+            double reuseRate() const
+            {
+                return acquisitions == 0 ? 0.0 : static_cast<double>(reuses) / acquisitions;
+            }
+        };
+
+        /**
+         * @param maxCachedBytes returned buffers beyond this many bytes are
+         * freed rather than kept for reuse
+         * @param hugePages whether to back buffers of 2 MiB or more with huge
+         * pages. Where explicit huge pages aren't available, transparent huge
+         * pages are requested instead
+         */
+        explicit BufferPool(std::size_t const maxCachedBytes = 64 * 1024 * 1024,
+                            bool const hugePages = false);
+
+        /**
+         * @brief the pool used by the library's own classes
+         */
+        static BufferPool &shared();
+
+        /**
+         * @brief sets how the shared pool is set up (see the constructor),
+         * e.g. so that the cipher buffers can be backed by huge pages
+         * @note throws std::logic_error if the shared pool is already in use;
+         * this must be called before any of the library's classes are created
+         */
+        static void configureShared(std::size_t const maxCachedBytes, bool const hugePages);
+
+        /**
+         * @return a buffer of at least size bytes
+         */
+        PooledBuffer borrow(std::size_t const size);
+
+        Stats stats() const;
+
+        ~BufferPool();
+
+      private:
+
+        friend class PooledBuffer;
+
+        BufferPool(BufferPool const &); // no impl required
+        BufferPool &operator=(BufferPool const &); // no impl required
+
+        // size classes go from a cache line (2^6) up to 2^40 bytes, with
+        // four classes (2^k, 1.25 * 2^k, 1.5 * 2^k and 1.75 * 2^k) for
+        // each power of two
+        static int const MIN_POWER = 6;
+        static int const STEPS_PER_POWER = 4;
+        static int const CLASSES = 35 * STEPS_PER_POWER;
+
+        struct SizeClass
+        {
+            std::mutex mutex;
+            std::vector<unsigned char*> free;
+        };
+
+        static int sizeClassFor(std::size_t const size);
+        static std::size_t classBytes(int const sizeClass);
+        unsigned char *acquire(std::size_t const size);
+        void release(unsigned char * const data, std::size_t const size);
+        unsigned char *allocate(std::size_t const bytes) const;
+        void deallocate(unsigned char * const data, std::size_t const bytes) const;
+
+        std::size_t const m_maxCachedBytes;
+        bool const m_hugePages;
+        SizeClass m_classes[CLASSES];
+
+        std::atomic<unsigned long> m_acquisitions;
+        std::atomic<unsigned long> m_reuses;
+        std::atomic<std::size_t> m_bytesInUse;
+        std::atomic<std::size_t> m_peakBytesInUse;
+        std::atomic<std::size_t> m_bytesCached;
+    };
+
+}
+
+#endif // BUFFER_POOL_HPP__
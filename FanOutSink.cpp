@@ -0,0 +1,372 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "FanOutSink.hpp"
+#include "BufferPool.hpp"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace cryptex
+{
+
+    namespace detail
+    {
+
+        /**
+         * @brief the stream that the encryptor writes to. The ciphertext is
+         * gathered in to chunks, each of which is queued for every destination
+         * and written out by that destination's own thread
+         */
+        class FanOut : public std::streambuf
+        {
+
+          public:
+            FanOut(std::vector<FanOutSink::Destination> const &destinations,
+                   std::size_t const chunkBytes,
+                   std::size_t const maxQueuedBytes);
+
+            std::ostream &stream() { return m_stream; }
+
+            /**
+             * @brief queues any partly filled chunk and waits for all
+             * destinations to be written to, rethrowing the first failure
+             */
+            void finish();
+
+            std::vector<FanOutSink::DestinationStats> stats() const;
+
+            ~FanOut();
+
+          protected:
+            int_type overflow(int_type const c);
+            std::streamsize xsputn(char const *s, std::streamsize const n);
+
+          private:
+
+            // a chunk of ciphertext, borrowed from the shared buffer pool
+            // and handed back once every destination has written it
+            struct Chunk
+            {
+                PooledBuffer buffer;
+                std::size_t bytes;
+            };
+            typedef boost::shared_ptr<Chunk> SharedChunk;
+
+            struct Queue
+            {
+                FanOutSink::Destination destination;
+                mutable std::mutex mutex;
+                std::condition_variable changed;
+                std::deque<SharedChunk> chunks;
+                std::size_t queuedBytes;
+                bool closing;
+                std::exception_ptr error;
+                FanOutSink::DestinationStats stats;
+                std::thread thread;
+            };
+
+            SharedChunk newChunk() const;
+            void publish();
+            void closeQueues();
+            static void drain(Queue &queue);
+
+            std::size_t const m_chunkBytes;
+            std::size_t const m_maxQueuedBytes;
+            std::vector<boost::shared_ptr<Queue> > m_queues;
+            SharedChunk m_current;
+            std::ostream m_stream;
+            bool m_finished;
+        };
+
+        FanOut::FanOut(std::vector<FanOutSink::Destination> const &destinations,
+                       std::size_t const chunkBytes,
+                       std::size_t const maxQueuedBytes)
+            : m_chunkBytes(std::max<std::size_t>(chunkBytes, 1))
+            , m_maxQueuedBytes(maxQueuedBytes)
+            , m_current(newChunk())
+            , m_stream(this)
+            , m_finished(false)
+        {
+            for (std::size_t i = 0; i < destinations.size(); ++i) {
+                boost::shared_ptr<Queue> queue = boost::make_shared<Queue>();
+                queue->destination = destinations[i];
+                queue->queuedBytes = 0;
+                queue->closing = false;
+                queue->stats.bytesWritten = 0;
+                queue->stats.secondsWriting = 0;
+                queue->stats.stalls = 0;
+                queue->thread = std::thread(&FanOut::drain, std::ref(*queue));
+                m_queues.push_back(queue);
+            }
+        }
+
+        FanOut::int_type
+        FanOut::overflow(int_type const c)
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                char const byte = traits_type::to_char_type(c);
+                xsputn(&byte, 1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize
+        FanOut::xsputn(char const *s, std::streamsize const n)
+        {
+            std::size_t remaining = static_cast<std::size_t>(n);
+            while (remaining > 0) {
+                std::size_t const taken = std::min(remaining, m_chunkBytes - m_current->bytes);
+                std::memcpy(m_current->buffer.data() + m_current->bytes, s, taken);
+                m_current->bytes += taken;
+                s += taken;
+                remaining -= taken;
+                if (m_current->bytes == m_chunkBytes) {
+                    publish();
+                }
+            }
+            return n;
+        }
+
+        FanOut::SharedChunk
+        FanOut::newChunk() const
+        {
+            SharedChunk const chunk = boost::make_shared<Chunk>();
+            chunk->buffer = BufferPool::shared().borrow(m_chunkBytes);
+            chunk->bytes = 0;
+            return chunk;
+        }
+
+        void
+        FanOut::publish()
+        {
+            if (m_current->bytes == 0) {
+                return;
+            }
+            SharedChunk const chunk = m_current;
+            m_current = newChunk();
+
+            //
+            // the same chunk is shared by all of the queues. Only when a
+            // queue is full do we have to wait for its destination to catch up
+            //
+            for (std::size_t i = 0; i < m_queues.size(); ++i) {
+                Queue &queue = *m_queues[i];
+                {
+                    std::unique_lock<std::mutex> lock(queue.mutex);
+                    if (!queue.chunks.empty() && queue.queuedBytes + chunk->bytes > m_maxQueuedBytes) {
+                        ++queue.stats.stalls;
+                        queue.changed.wait(lock, [&queue, &chunk, this]() {
+                            return queue.chunks.empty() || queue.queuedBytes + chunk->bytes <= m_maxQueuedBytes;
+                        });
+                    }
+                    queue.chunks.push_back(chunk);
+                    queue.queuedBytes += chunk->bytes;
+                }
+                queue.changed.notify_all();
+            }
+        }
+
+        void
+        FanOut::drain(Queue &queue)
+        {
+            while (true) {
+                SharedChunk chunk;
+                bool failed;
+                {
+                    std::unique_lock<std::mutex> lock(queue.mutex);
+                    queue.changed.wait(lock, [&queue]() { return queue.closing || !queue.chunks.empty(); });
+                    if (queue.chunks.empty()) {
+                        return;
+                    }
+                    chunk = queue.chunks.front();
+                    failed = static_cast<bool>(queue.error);
+                }
+
+                //
+                // once a destination has failed, the rest of its chunks are
+                // just discarded
+                //
+                std::exception_ptr error;
+                std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+                if (!failed) {
+                    try {
+                        queue.destination(reinterpret_cast<char const*>(chunk->buffer.data()), chunk->bytes);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                {
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    queue.chunks.pop_front();
+                    queue.queuedBytes -= chunk->bytes;
+                    if (error) {
+                        queue.error = error;
+                    } else if (!failed) {
+                        queue.stats.bytesWritten += chunk->bytes;
+                        queue.stats.secondsWriting += seconds;
+                    }
+                }
+                queue.changed.notify_all();
+            }
+        }
+
+        void
+        FanOut::closeQueues()
+        {
+            for (std::size_t i = 0; i < m_queues.size(); ++i) {
+                {
+                    std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+                    m_queues[i]->closing = true;
+                }
+                m_queues[i]->changed.notify_all();
+            }
+            for (std::size_t i = 0; i < m_queues.size(); ++i) {
+                if (m_queues[i]->thread.joinable()) {
+                    m_queues[i]->thread.join();
+                }
+            }
+        }
+
+        void
+        FanOut::finish()
+        {
+            publish();
+            closeQueues();
+            m_finished = true;
+            for (std::size_t i = 0; i < m_queues.size(); ++i) {
+                if (m_queues[i]->error) {
+                    std::rethrow_exception(m_queues[i]->error);
+                }
+            }
+        }
+
+        std::vector<FanOutSink::DestinationStats>
+        FanOut::stats() const
+        {
+            std::vector<FanOutSink::DestinationStats> stats;
+            for (std::size_t i = 0; i < m_queues.size(); ++i) {
+                std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+                stats.push_back(m_queues[i]->stats);
+            }
+            return stats;
+        }
+
+        FanOut::~FanOut()
+        {
+            if (!m_finished) {
+                closeQueues();
+            }
+        }
+
+    }
+
+    FanOutSink::Destination
+    FanOutSink::toStream(std::ostream &stream)
+    {
+        std::ostream *out = &stream;
+        return [out](char const *data, std::size_t const bytes) {
+            // flushed so that a failure is seen by the destination's thread
+            if (!out->write(data, bytes).flush()) {
+                throw std::runtime_error("cryptex: unable to write to fan out stream");
+            }
+        };
+    }
+
+    FanOutSink::Destination
+    FanOutSink::toFd(int const fd)
+    {
+        return [fd](char const *data, std::size_t const bytes) {
+            std::size_t written = 0;
+            while (written < bytes) {
+                ssize_t const put = ::write(fd, data + written, bytes - written);
+                if (put < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("cryptex: write failed: ") + std::strerror(errno));
+                }
+                written += put;
+            }
+        };
+    }
+
+    FanOutSink::FanOutSink(std::vector<Destination> const &destinations,
+                           unsigned long const sourceLength,
+                           SharedEncryptor const &enc,
+                           std::size_t const chunkBytes,
+                           std::size_t const maxQueuedBytes)
+        : m_sourceLength(sourceLength)
+        , m_pos(0)
+        , m_enc(enc)
+        , m_fanOut(boost::make_shared<detail::FanOut>(destinations, chunkBytes, maxQueuedBytes))
+    {}
+
+    std::streamsize
+    FanOutSink::write(char_type const * const buf, std::streamsize const n) const
+    {
+        //
+        // see EncryptionSink::write; the difference is that the encryptor
+        // writes to the fan out stream rather than to a single underlying stream
+        //
+        std::ostream &out = m_fanOut->stream();
+        for (unsigned long i = 0; i < static_cast<unsigned long>(n) ; ++i) {
+            m_enc->encrypt(static_cast<unsigned char>(buf[i]), out, (m_pos == m_sourceLength-1));
+            ++m_pos;
+        }
+
+        if (n > 0 && m_pos == m_sourceLength) {
+            m_enc->finish(out);
+            m_fanOut->finish();
+        }
+        return n;
+    }
+
+    std::vector<FanOutSink::DestinationStats>
+    FanOutSink::stats() const
+    {
+        return m_fanOut->stats();
+    }
+
+    FanOutSink::~FanOutSink()
+    {
+    }
+
+}
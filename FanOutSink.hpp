@@ -0,0 +1,128 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef FAN_OUT_SINK_HPP__
+#define FAN_OUT_SINK_HPP__
+
+#include "IEncryptor.hpp"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <boost/iostreams/categories.hpp>  // sink_tag
+#include <cstddef>
+#include <iosfwd>                          // streamsize
+#include <vector>
+
+namespace cryptex
+{
+
+    namespace detail
+    {
+        class FanOut;
+    }
+
+    /**
+     * @brief like an EncryptionSink, but the ciphertext is written to any
+     * number of destinations. The data is only encrypted once; the
+     * ciphertext is gathered in to chunks which are queued for each
+     * destination and written out by a thread per destination, so a slow
+     * destination only holds up the encryption once its queue is full.
+     */
+    class FanOutSink
+    {
+
+      public:
+        typedef boost::shared_ptr<IEncryptor> SharedEncryptor;
+        typedef char                          char_type;
+        typedef boost::iostreams::sink_tag    category;
+
+        // writes all of the given bytes to a destination
+        typedef boost::function<void (char const *, std::size_t)> Destination;
+
+        // how a destination has fared so far
+        struct DestinationStats
+        {
+            unsigned long long bytesWritten;
+            double secondsWriting;
+
+            // the number of times the encryption had to wait for this
+            // destination's queue to drain
+            unsigned long stalls;
+
+            double bytesPerSecond() const
+            {
+                return secondsWriting > 0 ? bytesWritten / secondsWriting : 0.0;
+            }
+        };
+
+        /**
+         * @brief helpers for the usual kinds of destination. The stream or
+         * descriptor must outlive the sink
+         */
+        static Destination toStream(std::ostream &stream);
+        static Destination toFd(int const fd);
+
+        /**
+         * @param destinations where the ciphertext is written
+         * @param sourceLength the size of the stream that will be copied from
+         * @param enc implements an encryption algorithm (see IEncryptor)
+         * @param chunkBytes the ciphertext is handed to the destinations in
+         * chunks of this size
+         * @param maxQueuedBytes the most ciphertext that may be waiting to be
+         * written to any one destination before the encryption waits for it
+         */
+        FanOutSink(std::vector<Destination> const &destinations,
+                   unsigned long const sourceLength,
+                   SharedEncryptor const &enc,
+                   std::size_t const chunkBytes = 64 * 1024,
+                   std::size_t const maxQueuedBytes = 8 * 1024 * 1024);
+
+        /**
+         * @param buf the data to be written
+         * @param n number of bytes to write
+         * @return the number of bytes written
+         * @note once the last byte has been written, this waits for every
+         * destination to be written to in full. If writing to a destination
+         * failed, the exception it threw is rethrown here
+         */
+        std::streamsize write(char_type const * const buf, std::streamsize const n) const;
+
+        std::vector<DestinationStats> stats() const;
+
+        ~FanOutSink();
+
+      private:
+
+        FanOutSink(); // no impl required
+
+        unsigned long const m_sourceLength;
+        mutable unsigned long m_pos;
+        SharedEncryptor m_enc;
+
+        // shared between the copies of the sink that boost::iostreams makes
+        boost::shared_ptr<detail::FanOut> m_fanOut;
+    };
+
+}
+
+#endif // FAN_OUT_SINK_HPP__
@@ -36,6 +36,10 @@ namespace cryptex
         void encrypt(unsigned char byte, std::ostream &out, bool const lastByte = false) const;
         void finish(std::ostream &out) const;
         virtual ~IEncryptor();
+      protected:
+        // the key, for derived classes which provide their own non-virtual
+        // encrypt and finish so that they can be inlined (see StaticEncryptionSink)
+        std::string const &key() const { return m_key; }
       private:
         std::string const m_key;
         IEncryptor(); // no impl required
@@ -0,0 +1,244 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "MessageChannel.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <stdint.h>
+
+#include <unistd.h>
+
+namespace cryptex
+{
+
+    namespace
+    {
+        // bytes requested from the descriptor per read
+        std::size_t const READ_SIZE = 64 * 1024;
+
+        void throwSystemError(char const *what)
+        {
+            throw std::runtime_error(std::string("cryptex: ") + what + ": " + std::strerror(errno));
+        }
+    }
+
+    MessageChannel::MessageChannel(int const fd,
+                                   EncryptorFactory const &makeEncryptor,
+                                   EncryptorFactory const &makeDecryptor,
+                                   std::size_t const maxBatchBytes,
+                                   std::size_t const maxFrameBytes,
+                                   std::size_t const blockBytes)
+        : m_fd(fd)
+        , m_makeEncryptor(makeEncryptor)
+        , m_makeDecryptor(makeDecryptor)
+        , m_maxBatchBytes(maxBatchBytes)
+        , m_maxFrameBytes(maxFrameBytes)
+        , m_blockBytes(blockBytes)
+        , m_writing(false)
+        , m_readPos(0)
+    {}
+
+    void
+    MessageChannel::send(std::string const &message)
+    {
+        Buffer const frame = makeFrame(message);
+        {
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            m_pending.insert(m_pending.end(), frame.begin(), frame.end());
+        }
+        flush();
+    }
+
+    void
+    MessageChannel::post(std::string const &message)
+    {
+        Buffer const frame = makeFrame(message);
+        bool batchIsFull;
+        {
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            m_pending.insert(m_pending.end(), frame.begin(), frame.end());
+            batchIsFull = m_pending.size() >= m_maxBatchBytes;
+        }
+        if (batchIsFull) {
+            flush();
+        }
+    }
+
+    void
+    MessageChannel::flush()
+    {
+        std::unique_lock<std::mutex> lock(m_sendMutex);
+        if (m_writing) {
+            return;
+        }
+
+        //
+        // keep writing until no more frames have been queued by other threads
+        // whilst we were writing; each time round, everything that has built
+        // up goes out in one go
+        //
+        m_writing = true;
+        Buffer batch;
+        while (!m_pending.empty()) {
+            batch.swap(m_pending);
+            lock.unlock();
+            try {
+                writeAll(batch);
+            } catch (...) {
+                lock.lock();
+                m_writing = false;
+                throw;
+            }
+            batch.clear();
+            lock.lock();
+        }
+        m_writing = false;
+    }
+
+    bool
+    MessageChannel::receive(std::string &message)
+    {
+        while (!extractFrame(message)) {
+            if (!readMore()) {
+                if (m_readPos != m_received.size()) {
+                    throw std::runtime_error("cryptex: connection closed part way through a frame");
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    MessageChannel::Buffer
+    MessageChannel::makeFrame(std::string const &message) const
+    {
+        SharedEncryptor enc = m_makeEncryptor();
+        std::ostringstream cipher;
+        for (std::string::size_type i = 0; i < message.size(); ++i) {
+            enc->encrypt(static_cast<unsigned char>(message[i]), cipher, i == message.size() - 1);
+        }
+        enc->finish(cipher);
+
+        std::string const cipherText = cipher.str();
+        uint32_t const length = cipherText.size();
+        Buffer frame(4 + cipherText.size());
+        frame[0] = static_cast<char>(length & 0xFF);
+        frame[1] = static_cast<char>((length >> 8) & 0xFF);
+        frame[2] = static_cast<char>((length >> 16) & 0xFF);
+        frame[3] = static_cast<char>((length >> 24) & 0xFF);
+        std::copy(cipherText.begin(), cipherText.end(), frame.begin() + 4);
+        return frame;
+    }
+
+    bool
+    MessageChannel::extractFrame(std::string &message)
+    {
+        std::size_t const available = m_received.size() - m_readPos;
+        if (available < 4) {
+            return false;
+        }
+        unsigned char const * const header = reinterpret_cast<unsigned char*>(&m_received[m_readPos]);
+        uint32_t const length = header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24);
+
+        //
+        // the header is checked as soon as it arrives, so that a bad peer
+        // can't have us buffer up to 4 GiB waiting for the rest of a frame
+        //
+        if (length > m_maxFrameBytes) {
+            throw std::runtime_error("cryptex: received frame is larger than the maximum frame size");
+        }
+        if (length % m_blockBytes != 0) {
+            throw std::runtime_error("cryptex: received frame is not a whole number of cipher blocks");
+        }
+        if (available - 4 < length) {
+            return false;
+        }
+
+        //
+        // the frame is consumed before it is decrypted, so that if it fails
+        // to decrypt the next receive carries on with the frame after it
+        //
+        char const * const cipherText = &m_received[m_readPos + 4];
+        m_readPos += 4 + length;
+
+        SharedEncryptor dec = m_makeDecryptor();
+        std::ostringstream plain;
+        for (uint32_t i = 0; i < length; ++i) {
+            dec->encrypt(static_cast<unsigned char>(cipherText[i]), plain, i == length - 1);
+        }
+        if (length > 0) {
+            dec->finish(plain);
+        }
+        message = plain.str();
+        return true;
+    }
+
+    bool
+    MessageChannel::readMore()
+    {
+        //
+        // discard frames that have already been consumed before reading more
+        //
+        if (m_readPos > 0) {
+            m_received.erase(m_received.begin(), m_received.begin() + m_readPos);
+            m_readPos = 0;
+        }
+
+        std::size_t const existing = m_received.size();
+        m_received.resize(existing + READ_SIZE);
+        ssize_t got;
+        do {
+            got = ::read(m_fd, &m_received[existing], READ_SIZE);
+        } while (got < 0 && errno == EINTR);
+        m_received.resize(existing + (got > 0 ? got : 0));
+        if (got < 0) {
+            throwSystemError("read failed");
+        }
+        return got > 0;
+    }
+
+    void
+    MessageChannel::writeAll(Buffer const &buffer) const
+    {
+        std::size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t const put = ::write(m_fd, &buffer[written], buffer.size() - written);
+            if (put < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwSystemError("write failed");
+            }
+            written += put;
+        }
+    }
+
+    MessageChannel::~MessageChannel()
+    {
+    }
+
+}
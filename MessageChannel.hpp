@@ -0,0 +1,146 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef MESSAGE_CHANNEL_HPP__
+#define MESSAGE_CHANNEL_HPP__
+
+#include "IEncryptor.hpp"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cryptex
+{
+
+    /**
+     * @brief sends and receives encrypted messages over a file descriptor
+     * such as a pipe or a socket. Unlike an EncryptionSink, the length of the
+     * whole stream doesn't need to be known up front: each message is
+     * encrypted on its own and written as a frame made up of a 4-byte
+     * (little endian) ciphertext length followed by the ciphertext. A message
+     * can therefore be decrypted as soon as its frame has arrived.
+     */
+    class MessageChannel
+    {
+
+      public:
+        typedef boost::shared_ptr<IEncryptor>  SharedEncryptor;
+
+        // since an encryptor carries state from one byte to the next, a
+        // fresh one is needed for every message
+        typedef boost::function<SharedEncryptor ()> EncryptorFactory;
+
+        /**
+         * @param fd the descriptor that frames are written to and read from.
+         * It is not closed by the channel
+         * @param makeEncryptor creates the encryptor used for each sent message
+         * @param makeDecryptor creates the decryptor used for each received message
+         * @param maxBatchBytes once this many bytes of posted frames are
+         * pending, they are written out without waiting for a flush
+         * @param maxFrameBytes received frames announcing more ciphertext
+         * than this are rejected, rather than buffered
+         * @param blockBytes received frames whose ciphertext isn't a whole
+         * number of cipher blocks of this size (8 for XTEA, 4 for XXTEA) are
+         * rejected
+         */
+        MessageChannel(int const fd,
+                       EncryptorFactory const &makeEncryptor,
+                       EncryptorFactory const &makeDecryptor,
+                       std::size_t const maxBatchBytes = 64 * 1024,
+                       std::size_t const maxFrameBytes = 16 * 1024 * 1024,
+                       std::size_t const blockBytes = 8);
+
+        /**
+         * @brief encrypts a message and writes it out straight away. If
+         * another thread is part way through writing, the frame is left for
+         * that thread to write along with any other frames that have queued
+         * up in the meantime, so that a backlog goes out in a single write
+         */
+        void send(std::string const &message);
+
+        /**
+         * @brief encrypts a message and queues it to be written on the next
+         * flush (or send)
+         */
+        void post(std::string const &message);
+
+        /**
+         * @brief writes out all queued frames, or leaves them to a thread
+         * which is already writing
+         */
+        void flush();
+
+        /**
+         * @brief blocks until a whole frame has arrived and decrypts it
+         * @param message receives the decrypted message
+         * @return false if the other end closed the connection
+         * @note should only be called by one thread at a time. Throws
+         * std::runtime_error if a frame is malformed (too large or not whole
+         * cipher blocks), in which case the channel can't be read any further,
+         * or if a frame fails to decrypt, in which case that frame is skipped
+         */
+        bool receive(std::string &message);
+
+        /**
+         * @note frames that have been posted but not flushed are discarded
+         */
+        ~MessageChannel();
+
+      private:
+
+        MessageChannel(); // no impl required
+        MessageChannel(MessageChannel const &); // no impl required
+        MessageChannel &operator=(MessageChannel const &); // no impl required
+
+        typedef std::vector<char> Buffer;
+
+        Buffer makeFrame(std::string const &message) const;
+        bool extractFrame(std::string &message);
+        bool readMore();
+        void writeAll(Buffer const &buffer) const;
+
+        int const m_fd;
+        EncryptorFactory m_makeEncryptor;
+        EncryptorFactory m_makeDecryptor;
+        std::size_t const m_maxBatchBytes;
+        std::size_t const m_maxFrameBytes;
+        std::size_t const m_blockBytes;
+
+        // frames waiting to be written and whether a thread is writing
+        std::mutex m_sendMutex;
+        Buffer m_pending;
+        bool m_writing;
+
+        // bytes read but not yet consumed; m_readPos marks the start of
+        // the first unconsumed frame
+        Buffer m_received;
+        std::size_t m_readPos;
+    };
+
+}
+
+#endif // MESSAGE_CHANNEL_HPP__
@@ -0,0 +1,285 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "Rekey.hpp"
+#include "BufferPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cryptex
+{
+
+    namespace
+    {
+        // below this many blocks per thread, starting a thread costs more
+        // than it saves
+        std::size_t const MIN_BLOCKS_PER_THREAD = 4096;
+
+        /**
+         * @brief the stream that the decryptor writes to. Each byte is passed
+         * straight on to the encryptor; one byte is held back so that the
+         * last one can be flagged as such
+         */
+        class ReEncryptingBuffer : public std::streambuf
+        {
+
+          public:
+            ReEncryptingBuffer(IEncryptor const &enc, std::ostream &out)
+                : m_enc(enc)
+                , m_out(out)
+                , m_held(0)
+                , m_holding(false)
+            {}
+
+            void finish()
+            {
+                if (m_holding) {
+                    m_enc.encrypt(m_held, m_out, true);
+                    m_holding = false;
+                }
+                m_enc.finish(m_out);
+            }
+
+          protected:
+            int_type overflow(int_type const c)
+            {
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    put(static_cast<unsigned char>(traits_type::to_char_type(c)));
+                }
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(char const *s, std::streamsize const n)
+            {
+                for (std::streamsize i = 0; i < n; ++i) {
+                    put(static_cast<unsigned char>(s[i]));
+                }
+                return n;
+            }
+
+          private:
+            void put(unsigned char const byte)
+            {
+                if (m_holding) {
+                    m_enc.encrypt(m_held, m_out, false);
+                }
+                m_held = byte;
+                m_holding = true;
+            }
+
+            IEncryptor const &m_enc;
+            std::ostream &m_out;
+            unsigned char m_held;
+            bool m_holding;
+        };
+
+        void rekeyBlockRange(unsigned char * const blocks,
+                             std::size_t const first,
+                             std::size_t const last,
+                             uint32_t const firstBlockIndex,
+                             XTEAKeySchedule const &from,
+                             XTEAKeySchedule const &to)
+        {
+            for (std::size_t b = first; b < last; ++b) {
+                uint32_t const blockIndex = firstBlockIndex + static_cast<uint32_t>(b);
+                uint32_t datablock[2];
+                detail::loadBlock(blocks + b * 8, datablock);
+                detail::decipher(from.rounds(), datablock, from.forBlock(blockIndex));
+                detail::encipher(to.rounds(), datablock, to.forBlock(blockIndex));
+                detail::storeBlock(datablock, blocks + b * 8);
+            }
+        }
+
+        /**
+         * @brief checks that the last block of the ciphertext deciphers to a
+         * length block (the data length, twice) consistent with the number of
+         * blocks before it
+         */
+        void checkLengthBlock(unsigned char const * const cipherBlock,
+                              uint32_t const lengthBlock,
+                              XTEAKeySchedule const &schedule)
+        {
+            unsigned char block[8];
+            std::memcpy(block, cipherBlock, 8);
+            detail::convertBytesAndDecypher(schedule.rounds(), block, schedule.forBlock(lengthBlock));
+            uint32_t dataLength;
+            uint32_t dataLengthAgain;
+            std::memcpy(&dataLength, block, 4);
+            std::memcpy(&dataLengthAgain, block + 4, 4);
+            if (dataLength != dataLengthAgain ||
+                dataLength / 8 + (dataLength % 8 > 0 ? 1 : 0) != lengthBlock) {
+                throw std::runtime_error("cryptex: wrong key or corrupt XTEA ciphertext");
+            }
+        }
+
+        /**
+         * @brief if in is seekable, checks the length block at the end of
+         * the stream, leaving the read position where it was
+         * @return whether the check could be made
+         */
+        bool checkLengthBlockUpFront(std::istream &in, XTEAKeySchedule const &schedule)
+        {
+            std::streampos const start = in.tellg();
+            if (start == std::streampos(-1) || !in.seekg(0, std::ios::end)) {
+                in.clear();
+                return false;
+            }
+            std::streamoff const size = in.tellg() - start;
+            if (size % 8 != 0) {
+                throw std::runtime_error("cryptex: stream is not XTEA ciphertext");
+            }
+            if (size > 0) {
+                unsigned char block[8];
+                in.seekg(start + static_cast<std::streamoff>(size - 8));
+                if (!in.read(reinterpret_cast<char*>(block), 8)) {
+                    throw std::runtime_error("cryptex: unable to read cipher block");
+                }
+                checkLengthBlock(block, static_cast<uint32_t>(size / 8) - 1, schedule);
+            }
+            in.seekg(start);
+            return true;
+        }
+    }
+
+    unsigned long rekey(std::istream &in,
+                        std::ostream &out,
+                        boost::shared_ptr<IEncryptor> const &dec,
+                        boost::shared_ptr<IEncryptor> const &enc,
+                        std::size_t const chunkBytes)
+    {
+        ReEncryptingBuffer reEncrypting(*enc, out);
+        std::ostream plain(&reEncrypting);
+
+        //
+        // as with the plaintext, the last byte of ciphertext is held back
+        // until we know that it is the last
+        //
+        PooledBuffer chunk = BufferPool::shared().borrow(chunkBytes);
+        char * const data = reinterpret_cast<char*>(chunk.data());
+        unsigned long bytesRead = 0;
+        unsigned char held = 0;
+        bool holding = false;
+        while (in.read(data, chunkBytes) || in.gcount() > 0) {
+            std::size_t const bytes = static_cast<std::size_t>(in.gcount());
+            if (holding) {
+                dec->encrypt(held, plain, false);
+            }
+            for (std::size_t i = 0; i + 1 < bytes; ++i) {
+                dec->encrypt(static_cast<unsigned char>(data[i]), plain, false);
+            }
+            held = static_cast<unsigned char>(data[bytes - 1]);
+            holding = true;
+            bytesRead += bytes;
+        }
+
+        //
+        // an empty stream, like the one an EncryptionSink makes of empty
+        // data, stays empty
+        //
+        if (!holding) {
+            return 0;
+        }
+        dec->encrypt(held, plain, true);
+        dec->finish(plain);
+        reEncrypting.finish();
+        return bytesRead;
+    }
+
+    void rekeyXTEABlocks(unsigned char * const blocks,
+                         std::size_t const blockCount,
+                         uint32_t const firstBlockIndex,
+                         XTEAKeySchedule const &from,
+                         XTEAKeySchedule const &to,
+                         unsigned const threads)
+    {
+        std::size_t const shares = std::max<std::size_t>(1, std::min<std::size_t>(threads, blockCount / MIN_BLOCKS_PER_THREAD));
+        std::size_t const perShare = blockCount / shares;
+
+        //
+        // the calling thread takes the last share, which also picks up the
+        // blocks left over from dividing the blocks evenly
+        //
+        std::vector<std::thread> workers;
+        for (std::size_t s = 0; s + 1 < shares; ++s) {
+            workers.push_back(std::thread(rekeyBlockRange, blocks, s * perShare, (s + 1) * perShare,
+                                          firstBlockIndex, std::cref(from), std::cref(to)));
+        }
+        rekeyBlockRange(blocks, (shares - 1) * perShare, blockCount, firstBlockIndex, from, to);
+        for (std::size_t s = 0; s < workers.size(); ++s) {
+            workers[s].join();
+        }
+    }
+
+    unsigned long rekeyXTEA(std::istream &in,
+                            std::ostream &out,
+                            SharedKeySchedule const &from,
+                            SharedKeySchedule const &to,
+                            std::size_t const chunkBytes,
+                            unsigned const threads)
+    {
+        unsigned const usedThreads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        std::size_t const blocksPerChunk = std::max<std::size_t>(1, chunkBytes / 8);
+        PooledBuffer chunk = BufferPool::shared().borrow(blocksPerChunk * 8);
+        char * const data = reinterpret_cast<char*>(chunk.data());
+
+        //
+        // when the stream is seekable, the length block is checked before
+        // anything is written, so that re-keying with the wrong key leaves
+        // out untouched
+        //
+        bool const checkedUpFront = checkLengthBlockUpFront(in, *from);
+
+        unsigned long bytesRead = 0;
+        while (in.read(data, blocksPerChunk * 8) || in.gcount() > 0) {
+            std::size_t const bytes = static_cast<std::size_t>(in.gcount());
+            if (bytes % 8 != 0) {
+                throw std::runtime_error("cryptex: stream is not XTEA ciphertext");
+            }
+            uint32_t const firstBlockIndex = static_cast<uint32_t>(bytesRead / 8);
+            bytesRead += bytes;
+
+            //
+            // otherwise it is checked before anything from the chunk that
+            // holds it is written, so that re-keying with the wrong key is at
+            // least caught at the end of the stream
+            //
+            if (!checkedUpFront && in.peek() == std::char_traits<char>::eof()) {
+                checkLengthBlock(chunk.data() + bytes - 8, static_cast<uint32_t>(bytesRead / 8) - 1, *from);
+            }
+
+            rekeyXTEABlocks(chunk.data(), bytes / 8, firstBlockIndex, *from, *to, usedThreads);
+            if (!out.write(data, bytes)) {
+                throw std::runtime_error("cryptex: unable to write re-encrypted data");
+            }
+        }
+        return bytesRead;
+    }
+
+}
@@ -0,0 +1,112 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef REKEY_HPP__
+#define REKEY_HPP__
+
+#include "IEncryptor.hpp"
+#include "XTEAKeySchedule.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+
+#include <stdint.h>
+
+namespace cryptex
+{
+
+    /**
+     * @brief re-encrypts ciphertext, e.g. under a new key or with a different
+     * algorithm, in a single pass. The ciphertext is put through dec and
+     * whatever dec produces is put straight through enc, so the plaintext
+     * only ever exists a chunk at a time in memory. As with asyncCrypt, the
+     * length of the input doesn't need to be known up front.
+     * @param in the ciphertext, read until end of stream
+     * @param out where the re-encrypted data is written
+     * @param dec decrypts the ciphertext (e.g. an XTEADecryptor)
+     * @param enc encrypts the plaintext again (e.g. an XTEAEncryptor or an
+     * XXTEAEncryptor)
+     * @param chunkBytes the ciphertext is read in chunks of this size
+     * @return the number of bytes read from in
+     * @note a wrong key or corrupt ciphertext is only noticed by dec at the
+     * end of the stream (both the XTEA and XXTEA decryptors throw
+     * std::runtime_error from finish), by which time most of the
+     * re-encrypted data has been written to out. Where that matters, write
+     * to somewhere temporary first, or use rekeyXTEA for XTEA to XTEA
+     */
+    unsigned long rekey(std::istream &in,
+                        std::ostream &out,
+                        boost::shared_ptr<IEncryptor> const &dec,
+                        boost::shared_ptr<IEncryptor> const &enc,
+                        std::size_t const chunkBytes = 64 * 1024);
+
+    /**
+     * @brief re-enciphers XTEA blocks in place. Each block is deciphered with
+     * the round keys that it was encrypted with and enciphered again with the
+     * new ones, without being stored in between. Since every block (the
+     * length block included) is independent of the others, the blocks are
+     * shared out between threads.
+     * @param blocks the 8-byte blocks
+     * @param blockCount how many blocks there are
+     * @param firstBlockIndex the index in the stream of the first block, which
+     * determines the round keys that it uses
+     * @param from the schedule that the blocks were encrypted with
+     * @param to the schedule to encrypt them with instead
+     * @param threads how many threads to use, including the calling one
+     */
+    void rekeyXTEABlocks(unsigned char * const blocks,
+                         std::size_t const blockCount,
+                         uint32_t const firstBlockIndex,
+                         XTEAKeySchedule const &from,
+                         XTEAKeySchedule const &to,
+                         unsigned const threads);
+
+    /**
+     * @brief re-encrypts XTEA ciphertext under a new key and/or number of
+     * rounds. This is the same as rekey with an XTEADecryptor and an
+     * XTEAEncryptor but works on whole chunks of blocks at a time (see
+     * rekeyXTEABlocks) rather than a byte at a time.
+     * @param in the ciphertext, read until end of stream
+     * @param out where the re-encrypted data is written
+     * @param from the schedule for the key that the data was encrypted with
+     * @param to the schedule for the key to encrypt with instead
+     * @param chunkBytes the ciphertext is read in chunks of (roughly) this size
+     * @param threads how many threads to use; 0 means one per hardware thread
+     * @return the number of bytes read from in
+     * @note throws std::runtime_error if the input isn't whole XTEA blocks or
+     * its length block doesn't decipher properly with from. When in is
+     * seekable, this is checked before anything is written to out; otherwise
+     * it is only checked once the end of the stream is reached, leaving the
+     * output incomplete
+     */
+    unsigned long rekeyXTEA(std::istream &in,
+                            std::ostream &out,
+                            SharedKeySchedule const &from,
+                            SharedKeySchedule const &to,
+                            std::size_t const chunkBytes = 4 * 1024 * 1024,
+                            unsigned const threads = 0);
+
+}
+
+#endif // REKEY_HPP__
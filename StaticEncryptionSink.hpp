@@ -0,0 +1,97 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef STATIC_ENCRYPTION_SINK_HPP__
+#define STATIC_ENCRYPTION_SINK_HPP__
+
+#include <boost/iostreams/categories.hpp>  // sink_tag
+#include <iosfwd>                          // streamsize
+#include <ostream>
+
+namespace cryptex
+{
+
+    /**
+     * @brief an EncryptionSink whose algorithm is fixed at compile time.
+     * The cipher is held by value and its encrypt and finish functions are
+     * called directly, so for a concrete cipher such as XTEAEncryptor the
+     * whole transform can be inlined in to the write loop. For algorithms
+     * only known at run time (e.g. loaded as plug-ins), use EncryptionSink.
+     * @tparam Cipher a copyable type providing
+     * encrypt(unsigned char, std::ostream &, bool) const and
+     * finish(std::ostream &) const, usually a class derived from IEncryptor
+     */
+    template <typename Cipher>
+    class StaticEncryptionSink
+    {
+
+      public:
+        typedef char                          char_type;
+        typedef boost::iostreams::sink_tag    category;
+
+        /**
+         * @param underlyingStream where the data is actually written
+         * @param sourceLength the size of the stream that will be copied from
+         * @param cipher implements an encryption algorithm; a copy is taken
+         */
+        StaticEncryptionSink(std::ostream &underlyingStream,
+                             unsigned long const sourceLength,
+                             Cipher const &cipher)
+            : m_underlyingStream(underlyingStream)
+            , m_sourceLength(sourceLength)
+            , m_pos(0)
+            , m_cipher(cipher)
+        {}
+
+        /**
+         * @param buf the data to be written
+         * @param n number of bytes to write
+         * @return the number of bytes written
+         * @note see EncryptionSink::write for how the last byte and the
+         * finishing up of the encryption process are signalled
+         */
+        std::streamsize write(char_type const * const buf, std::streamsize const n) const
+        {
+            for (unsigned long i = 0; i < static_cast<unsigned long>(n) ; ++i) {
+                m_cipher.encrypt(static_cast<unsigned char>(buf[i]), m_underlyingStream, (m_pos == m_sourceLength-1));
+                ++m_pos;
+            }
+
+            if (n > 0 && m_pos == m_sourceLength) {
+                m_cipher.finish(m_underlyingStream);
+            }
+            return n;
+        }
+
+      private:
+
+        StaticEncryptionSink(); // no impl required
+
+        std::ostream &m_underlyingStream;
+        unsigned long const m_sourceLength;
+        mutable unsigned long m_pos;
+        Cipher m_cipher;
+    };
+
+}
+
+#endif // STATIC_ENCRYPTION_SINK_HPP__
@@ -0,0 +1,131 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef XTEA_APPEND_HPP__
+#define XTEA_APPEND_HPP__
+
+#include "EncryptionSink.hpp"
+#include "XTEAEncryptor.hpp"
+#include "XTEAKeySchedule.hpp"
+
+#include <boost/make_shared.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cryptex
+{
+
+    namespace detail
+    {
+
+        /**
+         * @brief reads and deciphers the 8-byte block with the given index
+         */
+        inline void readAndDecipherBlock(std::istream &in,
+                                         uint32_t const blockIndex,
+                                         XTEARoundKeys const &roundKeys,
+                                         unsigned char block[8])
+        {
+            in.seekg(static_cast<std::streamoff>(blockIndex) * 8, std::ios::beg);
+            if (!in.read(reinterpret_cast<char*>(block), 8)) {
+                throw std::runtime_error("cryptex: unable to read cipher block");
+            }
+            convertBytesAndDecypher(roundKeys.rounds(), block, roundKeys.forBlock(blockIndex));
+        }
+
+    }
+
+    /**
+     * @brief prepares an XTEA-encrypted stream for having more data appended
+     * to it. Only the length block and (if present) the partial last data
+     * block are read and deciphered; the rest of the stream is untouched.
+     * @param cipherStream the encrypted data, opened for both reading and
+     * writing (e.g. an fstream with in | out | binary)
+     * @param key the key that the stream was encrypted with
+     * @param rounds the number of rounds that the stream was encrypted with
+     * @return an encryptor which continues where the original one left off.
+     * The put position of cipherStream is moved to where the new data must be
+     * written, so the encryptor can be handed straight to an EncryptionSink
+     * wrapping cipherStream with the length of the data being appended
+     * @note an empty stream (as written for empty data) is resumed from the
+     * start. Otherwise throws std::runtime_error if the stream doesn't look
+     * like it was encrypted with the given key and rounds
+     */
+    inline EncryptionSink::SharedEncryptor
+    resumeXTEAEncryptor(std::iostream &cipherStream, std::string const &key, int const rounds)
+    {
+        cipherStream.seekg(0, std::ios::end);
+        std::streamoff const size = cipherStream.tellg();
+        XTEARoundKeys const roundKeys(key, rounds);
+
+        //
+        // an EncryptionSink writes nothing at all for empty data, so an
+        // empty stream is simply encrypted from the start
+        //
+        if (size == 0) {
+            cipherStream.clear();
+            cipherStream.seekp(0, std::ios::beg);
+            return boost::make_shared<XTEAEncryptor>(key, roundKeys);
+        }
+        if (size < 8 || size % 8 != 0) {
+            throw std::runtime_error("cryptex: stream is not XTEA ciphertext");
+        }
+
+        //
+        // the last 8-byte block holds the original data length
+        //
+        uint32_t const lengthBlock = static_cast<uint32_t>(size / 8) - 1;
+        unsigned char block[8];
+        detail::readAndDecipherBlock(cipherStream, lengthBlock, roundKeys, block);
+        uint32_t dataLength;
+        uint32_t dataLengthAgain;
+        std::memcpy(&dataLength, block, 4);
+        std::memcpy(&dataLengthAgain, block + 4, 4);
+
+        //
+        // the bytes of a partially filled last data block have to be carried
+        // over in to the first block written by the resumed encryptor
+        //
+        uint32_t const fullBlocks = dataLength / 8;
+        if (dataLength != dataLengthAgain ||
+            fullBlocks + (dataLength % 8 > 0 ? 1 : 0) != lengthBlock) {
+            throw std::runtime_error("cryptex: wrong key or corrupt XTEA ciphertext");
+        }
+
+        std::vector<unsigned char> pending;
+        if (dataLength % 8 > 0) {
+            detail::readAndDecipherBlock(cipherStream, fullBlocks, roundKeys, block);
+            pending.assign(block, block + dataLength % 8);
+        }
+
+        cipherStream.clear();
+        cipherStream.seekp(static_cast<std::streamoff>(fullBlocks) * 8, std::ios::beg);
+        return boost::make_shared<XTEAEncryptor>(key, roundKeys, fullBlocks, pending);
+    }
+
+}
+
+#endif // XTEA_APPEND_HPP__
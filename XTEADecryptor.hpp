@@ -23,7 +23,14 @@ THE SOFTWARE.*/
 #ifndef I_ENCRYPTOR_XTEA_DECRYPTOR_HPP__
 #define I_ENCRYPTOR_XTEA_DECRYPTOR_HPP__
 
+#include "BufferPool.hpp"
 #include "IEncryptor.hpp"
+#include "XTEAKeySchedule.hpp"
+
+#include <boost/make_shared.hpp>
+
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 
@@ -34,77 +41,75 @@ namespace cryptex
 
     long const BUFFER_SIZE = 1000;
 
-    namespace detail
-    {
-
-        // the xtea encipher algorithm as found on wikipedia
-        void decipher(unsigned int num_rounds, uint32_t v[2], uint32_t const key[4])
-        {
-            unsigned int i;
-            uint32_t v0=v[0], v1=v[1], delta=0x9E3779B9, sum=delta*num_rounds;
-            for (i=0; i < num_rounds; i++) {
-                v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + key[(sum>>11) & 3]);
-                sum -= delta;
-                v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + key[sum & 3]);
-            }
-            v[0]=v0; v[1]=v1;
-        }
-
-        // helper code as found here:
-        // http://codereview.stackexchange.com/questions/2050/codereview-tiny-encryption-algorithm-for-arbitrary-sized-data
-        void convertBytesAndDecypher(unsigned int num_rounds, unsigned char * buffer, uint32_t const key[4])
-        {
-            uint32_t datablock[2];
-
-            datablock[0] = (buffer[0] << 24) | (buffer[1] << 16)  | (buffer[2] << 8) | (buffer[3]);
-            datablock[1] = (buffer[4] << 24) | (buffer[5] << 16)  | (buffer[6] << 8) | (buffer[7]);
-
-            decipher(num_rounds, datablock, key);
-
-            buffer[0] = static_cast<unsigned char>((datablock[0] >> 24) & 0xFF);
-            buffer[1] = static_cast<unsigned char>((datablock[0] >> 16) & 0xFF);
-            buffer[2] = static_cast<unsigned char>((datablock[0] >> 8) & 0xFF);
-            buffer[3] = static_cast<unsigned char>((datablock[0]) & 0xFF);
-            buffer[4] = static_cast<unsigned char>((datablock[1] >> 24) & 0xFF);
-            buffer[5] = static_cast<unsigned char>((datablock[1] >> 16) & 0xFF);
-            buffer[6] = static_cast<unsigned char>((datablock[1] >> 8) & 0xFF);
-            buffer[7] = static_cast<unsigned char>((datablock[1]) & 0xFF);
-        }
-
-    }
-
     class XTEADecryptor : public IEncryptor
     {
 
       public:
         XTEADecryptor(std::string const &key, int const rounds)
             : IEncryptor(key)
-            , m_keyIndex(0)
+            , m_bytesInBlock(0)
+            , m_roundKeys(key, rounds)
+            , m_blockIndex(0)
             , m_rounds(rounds)
             , m_origDataLength(0)
+            , m_origDataLengthCopy(0)
             , m_dataWrittenSoFar(0)
+            , m_mainDataFuffer(BufferPool::shared().borrow(BUFFER_SIZE + 24))
+            , m_bytesInMainDataBuffer(0)
+        {
+
+        }
+
+        /**
+         * @param key the key to decrypt with
+         * @param roundKeys the round keys for key, e.g. from a schedule shared
+         * through an XTEAKeyScheduleCache
+         */
+        XTEADecryptor(std::string const &key, XTEARoundKeys const &roundKeys)
+            : IEncryptor(key)
+            , m_bytesInBlock(0)
+            , m_roundKeys(roundKeys)
+            , m_blockIndex(0)
+            , m_rounds(roundKeys.rounds())
+            , m_origDataLength(0)
+            , m_origDataLengthCopy(0)
+            , m_dataWrittenSoFar(0)
+            , m_mainDataFuffer(BufferPool::shared().borrow(BUFFER_SIZE + 24))
+            , m_bytesInMainDataBuffer(0)
+        {
+
+        }
+
+        /**
+         * @brief non-virtual versions of IEncryptor::encrypt and IEncryptor::finish.
+         * These hide the base class versions so that when the concrete type is
+         * known (e.g. in a StaticEncryptionSink) the transform can be inlined
+         * rather than dispatched through doCryptTransform and doFinish
+         */
+        void encrypt(unsigned char byte, std::ostream &out, bool const lastByte = false) const
         {
+            XTEADecryptor::doCryptTransform(byte, key(), out, lastByte);
+        }
 
+        void finish(std::ostream &out) const
+        {
+            XTEADecryptor::doFinish(key(), out);
         }
 
       private:
 
         // for storing each 8-byte block of data
-        typedef std::vector<unsigned char> Bytes;
-        mutable Bytes m_eightByteBlock;
+        mutable unsigned char m_eightByteBlock[8];
+        mutable int m_bytesInBlock;
 
-        // for storing the 16 byte key used during the encryption process
-        // the key is generated as a function of the string. A 16 byte key
-        // which contains 4 uint32_t are therefore generated from 16 of
-        // the string key characters
-        typedef std::vector<uint32_t> TeaKey;
+        // the round keys for each 8-byte block. The tea key for a block
+        // is generated as a function of the string key, with 4 uint32_t
+        // being derived from 16 of the string key characters
+        XTEARoundKeys m_roundKeys;
 
-        // the number of rounds used by the XTEA process. This is usually
-        // 32 or 64 or 128 etc.
-        mutable TeaKey m_teaKey;
-
-        // determines where in the string key the tea key data is derived from
-        mutable std::string::size_type m_keyIndex;
+        // the index of the next 8-byte block to be decrypted, which
+        // determines the round keys that it is decrypted with
+        mutable uint32_t m_blockIndex;
 
         // the number of rounds used by the XTEA process. This is usually
         // 32 or 64 or 128 etc.
@@ -114,13 +119,17 @@ namespace cryptex
         // the encrypted data
         mutable uint32_t m_origDataLength;
 
+        // the second copy of the length held in the length block
+        mutable uint32_t m_origDataLengthCopy;
+
         // the buffer is written to the stream in BUFFER_SIZE bursts. This
         // variable basically accumulates the number of such bursts * BUFFER_SIZE
         mutable uint32_t m_dataWrittenSoFar;
 
         // a buffer that stores decrypted bytes that will be written to the
-        // underlying output stream
-        mutable Bytes m_mainDataFuffer;
+        // underlying output stream, borrowed from the shared buffer pool
+        mutable PooledBuffer m_mainDataFuffer;
+        mutable long m_bytesInMainDataBuffer;
 
         /**
          * @brief recovers the length proper of the encrypted data from the
@@ -135,6 +144,22 @@ namespace cryptex
             dat[3] = m_eightByteBlock[3];
             uint32_t *recovered = reinterpret_cast<uint32_t*>(dat);
             m_origDataLength = *recovered;
+            std::memcpy(&m_origDataLengthCopy, m_eightByteBlock + 4, 4);
+        }
+
+        /**
+         * @brief checks that the recovered length is the same in both halves
+         * of the length block and fits the number of blocks before it. This
+         * won't be the case if the data was decrypted with the wrong key,
+         * is corrupt or was cut short
+         */
+        void checkDataLength() const
+        {
+            uint32_t const dataBlocks = m_origDataLength / 8 + (m_origDataLength % 8 > 0 ? 1 : 0);
+            if (m_bytesInBlock != 0 || m_blockIndex == 0 ||
+                m_origDataLength != m_origDataLengthCopy || dataBlocks != m_blockIndex - 1) {
+                throw std::runtime_error("cryptex: wrong key or corrupt XTEA ciphertext");
+            }
         }
 
         /**
@@ -142,10 +167,8 @@ namespace cryptex
          */
         void add8ByteBlockToMainDataBuffer() const
         {
-            Bytes::iterator it = m_eightByteBlock.begin();
-            for (; it != m_eightByteBlock.end(); ++it) {
-                m_mainDataFuffer.push_back(*it);
-            }
+            std::memcpy(m_mainDataFuffer.data() + m_bytesInMainDataBuffer, m_eightByteBlock, 8);
+            m_bytesInMainDataBuffer += 8;
         }
 
         /**
@@ -168,8 +191,7 @@ namespace cryptex
         {
             addByteToTheByteBlock(byte);
             if (thereAre8BytesInTheByteBlock()) {
-                prepareTEAKey(key);
-                detail::convertBytesAndDecypher(m_rounds, &m_eightByteBlock.front(), &m_teaKey.front());
+                decipherByteBlock();
 
                 //
                 // recover length of original data from first 4 bytes of last 8-byte block;
@@ -189,17 +211,16 @@ namespace cryptex
                 //
                 checkAndWriteOutBufferWindow(out);
 
-                Bytes().swap(m_eightByteBlock);
+                m_bytesInBlock = 0;
             }
         }
 
         void checkAndWriteOutBufferWindow(std::ostream &out) const
         {
-            if (m_mainDataFuffer.size() == BUFFER_SIZE + 24) {
-                out.write(reinterpret_cast<char*>(&m_mainDataFuffer.front()), BUFFER_SIZE);
-                Bytes tempBuffer;
-                tempBuffer.assign(m_mainDataFuffer.begin() + BUFFER_SIZE, m_mainDataFuffer.end());
-                m_mainDataFuffer.assign(tempBuffer.begin(), tempBuffer.end());
+            if (m_bytesInMainDataBuffer == BUFFER_SIZE + 24) {
+                out.write(reinterpret_cast<char*>(m_mainDataFuffer.data()), BUFFER_SIZE);
+                std::memmove(m_mainDataFuffer.data(), m_mainDataFuffer.data() + BUFFER_SIZE, 24);
+                m_bytesInMainDataBuffer = 24;
                 m_dataWrittenSoFar += BUFFER_SIZE;
             }
         }
@@ -207,56 +228,27 @@ namespace cryptex
         void doFinish(std::string const &key, std::ostream &out) const
         {
             //
-            // write out buffer up to the recovered data length
+            // write out buffer up to the recovered data length, having made
+            // sure that the buffer holds that much
             //
-            out.write(reinterpret_cast<char*>(&m_mainDataFuffer.front()), m_origDataLength - m_dataWrittenSoFar);
+            checkDataLength();
+            out.write(reinterpret_cast<char*>(m_mainDataFuffer.data()), m_origDataLength - m_dataWrittenSoFar);
         }
 
         void addByteToTheByteBlock(unsigned char &byte) const
         {
-            m_eightByteBlock.push_back(byte);
+            m_eightByteBlock[m_bytesInBlock++] = byte;
         }
 
         bool thereAre8BytesInTheByteBlock() const
         {
-            return m_eightByteBlock.size() == 8;
+            return m_bytesInBlock == 8;
         }
 
-        void generateKey(std::string const &userKey, unsigned char keyDat[4]) const
+        void decipherByteBlock() const
         {
-            for (int i = 0; i < 4; ++i) {
-                checkKeyIndexAndResetIfTooBig(userKey);
-                keyDat[i] = userKey[m_keyIndex];
-                ++m_keyIndex;
-            }
-        }
-
-        void prepareTEAKey(std::string const &key) const
-        {
-            unsigned char dat[4];
-            TeaKey().swap(m_teaKey);
-            generateKey(key, dat);
-            uint32_t *k1 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k1);
-
-            generateKey(key, dat);
-            uint32_t *k2 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k2);
-
-            generateKey(key, dat);
-            uint32_t *k3 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k3);
-
-            generateKey(key, dat);
-            uint32_t *k4 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k4);
-        }
-
-        void checkKeyIndexAndResetIfTooBig(std::string const &key) const
-        {
-            if (m_keyIndex >= key.length()) {
-                m_keyIndex = 0;
-            }
+            detail::convertBytesAndDecypher(m_rounds, m_eightByteBlock, m_roundKeys.forBlock(m_blockIndex));
+            ++m_blockIndex;
         }
 
     };
@@ -24,6 +24,12 @@ THE SOFTWARE.*/
 #define I_ENCRYPTOR_XTEA_ENCRYPTOR_HPP__
 
 #include "IEncryptor.hpp"
+#include "XTEAKeySchedule.hpp"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -31,72 +37,79 @@ THE SOFTWARE.*/
 namespace cryptex
 {
 
-    namespace detail
-    {
-
-        // the xtea encipher algorithm as found on wikipedia
-        void encipher(unsigned int num_rounds, uint32_t v[2], uint32_t const key[4])
-        {
-            unsigned int i;
-            uint32_t v0=v[0], v1=v[1], sum=0, delta=0x9E3779B9;
-            for (i=0; i < num_rounds; i++) {
-                v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + key[sum & 3]);
-                sum += delta;
-                v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + key[(sum>>11) & 3]);
-            }
-            v[0]=v0; v[1]=v1;
-        }
-
-        // helper code found here:
-        // http://codereview.stackexchange.com/questions/2050/codereview-tiny-encryption-algorithm-for-arbitrary-sized-data
-        void convertBytesAndEncipher(unsigned int num_rounds, unsigned char * buffer, uint32_t const key[4])
-        {
-            uint32_t datablock[2];
-
-            datablock[0] = (buffer[0] << 24) | (buffer[1] << 16)  | (buffer[2] << 8) | (buffer[3]);
-            datablock[1] = (buffer[4] << 24) | (buffer[5] << 16)  | (buffer[6] << 8) | (buffer[7]);
-
-            encipher(num_rounds, datablock, key);
-
-            buffer[0] = static_cast<unsigned char>((datablock[0] >> 24) & 0xFF);
-            buffer[1] = static_cast<unsigned char>((datablock[0] >> 16) & 0xFF);
-            buffer[2] = static_cast<unsigned char>((datablock[0] >> 8) & 0xFF);
-            buffer[3] = static_cast<unsigned char>((datablock[0]) & 0xFF);
-            buffer[4] = static_cast<unsigned char>((datablock[1] >> 24) & 0xFF);
-            buffer[5] = static_cast<unsigned char>((datablock[1] >> 16) & 0xFF);
-            buffer[6] = static_cast<unsigned char>((datablock[1] >> 8) & 0xFF);
-            buffer[7] = static_cast<unsigned char>((datablock[1]) & 0xFF);
-        }
-    }
-
     class XTEAEncryptor : public IEncryptor
     {
 
       public:
         XTEAEncryptor(std::string const &key, int const rounds)
             : IEncryptor(key)
-            , m_keyIndex(0)
+            , m_bytesInBlock(0)
+            , m_roundKeys(key, rounds)
+            , m_blockIndex(0)
             , m_rounds(rounds)
             , m_origDataLength(0)
         {
 
         }
 
+        /**
+         * @param key the key to encrypt with
+         * @param roundKeys the round keys for key, e.g. from a schedule shared
+         * through an XTEAKeyScheduleCache
+         * @param blocksWritten when resuming encryption of a previously
+         * encrypted stream, the number of complete 8-byte data blocks already
+         * present in it (not including any partial or length block)
+         * @param pending when resuming, plaintext bytes (fewer than 8) from the
+         * partial last data block which are to be re-encrypted along with the
+         * new data. Throws std::invalid_argument if there are 8 or more
+         */
+        XTEAEncryptor(std::string const &key,
+                      XTEARoundKeys const &roundKeys,
+                      uint32_t const blocksWritten = 0,
+                      std::vector<unsigned char> const &pending = std::vector<unsigned char>())
+            : IEncryptor(key)
+            , m_bytesInBlock(pending.size())
+            , m_roundKeys(roundKeys)
+            , m_blockIndex(blocksWritten)
+            , m_rounds(roundKeys.rounds())
+            , m_origDataLength(blocksWritten * 8)
+        {
+            if (pending.size() >= 8) {
+                throw std::invalid_argument("cryptex: at most 7 pending bytes can be carried over");
+            }
+            std::copy(pending.begin(), pending.end(), m_eightByteBlock);
+        }
+
+        /**
+         * @brief non-virtual versions of IEncryptor::encrypt and IEncryptor::finish.
+         * These hide the base class versions so that when the concrete type is
+         * known (e.g. in a StaticEncryptionSink) the transform can be inlined
+         * rather than dispatched through doCryptTransform and doFinish
+         */
+        void encrypt(unsigned char byte, std::ostream &out, bool const lastByte = false) const
+        {
+            XTEAEncryptor::doCryptTransform(byte, key(), out, lastByte);
+        }
+
+        void finish(std::ostream &out) const
+        {
+            XTEAEncryptor::doFinish(key(), out);
+        }
+
       private:
 
         // for storing an 8-byte block of data
-        typedef std::vector<unsigned char> Bytes;
-        mutable Bytes m_eightByteBlock;
+        mutable unsigned char m_eightByteBlock[8];
+        mutable int m_bytesInBlock;
 
-        // for storing the 16 byte key used during the encryption process
-        // the key is generated as a function of the string. A 16 byte key
-        // which contains 4 uint32_t are therefore generated from 16 of
-        // the string key characters
-        typedef std::vector<uint32_t> TeaKey;
-        mutable TeaKey m_teaKey;
+        // the round keys for each 8-byte block. The tea key for a block
+        // is generated as a function of the string key, with 4 uint32_t
+        // being derived from 16 of the string key characters
+        XTEARoundKeys m_roundKeys;
 
-        // determines where in the string key the tea key data is derived from
-        mutable std::string::size_type m_keyIndex;
+        // the index of the next 8-byte block to be encrypted, which
+        // determines the round keys that it is encrypted with
+        mutable uint32_t m_blockIndex;
 
         // the number of rounds used by the XTEA process. This is usually
         // 32 or 64 or 128 etc.
@@ -118,10 +131,9 @@ namespace cryptex
         {
             addByteToTheByteBlock(byte);
             if (thereAre8BytesInTheByteBlock()) {
-                prepareTEAKey(key);
-                detail::convertBytesAndEncipher(m_rounds, &m_eightByteBlock.front(), &m_teaKey.front());
-                out.write(reinterpret_cast<char*>(&m_eightByteBlock.front()), 8);
-                Bytes().swap(m_eightByteBlock);
+                encipherByteBlock();
+                out.write(reinterpret_cast<char*>(m_eightByteBlock), 8);
+                m_bytesInBlock = 0;
                 m_origDataLength += 8;
             }
         }
@@ -135,19 +147,19 @@ namespace cryptex
          */
         void padOutLeftOverBytesTo8ByteBlock(std::string const &key, std::ostream &out) const
         {
-            if (m_eightByteBlock.size() > 0) {
-                m_origDataLength += m_eightByteBlock.size();
+            if (m_bytesInBlock > 0) {
+                m_origDataLength += m_bytesInBlock;
 
-                for (int i = 0; i < (8 - m_eightByteBlock.size()); ++i) {
+                int const padding = 8 - m_bytesInBlock;
+                for (int i = 0; i < padding; ++i) {
                     unsigned char extra = 0;
                     uint32_t val = extra;
                     addByteToTheByteBlock(extra);
                 }
-                prepareTEAKey(key);
-                detail::convertBytesAndEncipher(m_rounds, &m_eightByteBlock.front(), &m_teaKey.front());
-                out.write(reinterpret_cast<char*>(&m_eightByteBlock.front()), 8);
+                encipherByteBlock();
+                out.write(reinterpret_cast<char*>(m_eightByteBlock), 8);
             }
-            Bytes().swap(m_eightByteBlock);
+            m_bytesInBlock = 0;
         }
 
         /**
@@ -173,9 +185,8 @@ namespace cryptex
                 addByteToTheByteBlock(extra);
                 ++c;
             }
-            prepareTEAKey(key);
-            detail::convertBytesAndEncipher(m_rounds, &m_eightByteBlock.front(), &m_teaKey.front());
-            out.write(reinterpret_cast<char*>(&m_eightByteBlock.front()), 8);
+            encipherByteBlock();
+            out.write(reinterpret_cast<char*>(m_eightByteBlock), 8);
         }
 
         /**
@@ -204,49 +215,18 @@ namespace cryptex
 
         void addByteToTheByteBlock(unsigned char &byte) const
         {
-            m_eightByteBlock.push_back(byte);
+            m_eightByteBlock[m_bytesInBlock++] = byte;
         }
 
         bool thereAre8BytesInTheByteBlock() const
         {
-            return m_eightByteBlock.size() == 8;
-        }
-
-        void generateKey(std::string const &userKey, unsigned char keyDat[4]) const
-        {
-            for (int i = 0; i < 4; ++i) {
-                checkKeyIndexAndResetIfTooBig(userKey);
-                keyDat[i] = userKey[m_keyIndex];
-                ++m_keyIndex;
-            }
+            return m_bytesInBlock == 8;
         }
 
-        void prepareTEAKey(std::string const &key) const
+        void encipherByteBlock() const
         {
-            unsigned char dat[4];
-            TeaKey().swap(m_teaKey);
-            generateKey(key, dat);
-            uint32_t *k1 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k1);
-
-            generateKey(key, dat);
-            uint32_t *k2 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k2);
-
-            generateKey(key, dat);
-            uint32_t *k3 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k3);
-
-            generateKey(key, dat);
-            uint32_t *k4 = reinterpret_cast<uint32_t*>(dat);
-            m_teaKey.push_back(*k4);
-        }
-
-        void checkKeyIndexAndResetIfTooBig(std::string const &key) const
-        {
-            if (m_keyIndex >= key.length()) {
-                m_keyIndex = 0;
-            }
+            detail::convertBytesAndEncipher(m_rounds, m_eightByteBlock, m_roundKeys.forBlock(m_blockIndex));
+            ++m_blockIndex;
         }
 
     };
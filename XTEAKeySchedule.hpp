@@ -0,0 +1,300 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef XTEA_KEY_SCHEDULE_HPP__
+#define XTEA_KEY_SCHEDULE_HPP__
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace cryptex
+{
+
+    namespace detail
+    {
+
+        /**
+         * @brief derives the 4 tea key words starting at a given position
+         * in the string key. Successive characters are taken, wrapping back
+         * to the start of the string key when its end is reached. An empty
+         * string key gives a tea key of zeros
+         */
+        inline void teaKeyAtIndex(std::string const &key,
+                                  std::string::size_type keyIndex,
+                                  uint32_t teaKey[4])
+        {
+            for (int k = 0; k < 4; ++k) {
+                unsigned char dat[4];
+                for (int i = 0; i < 4; ++i) {
+                    if (keyIndex >= key.length()) {
+                        keyIndex = 0;
+                    }
+                    dat[i] = key.empty() ? 0 : key[keyIndex];
+                    ++keyIndex;
+                }
+                std::memcpy(&teaKey[k], dat, 4);
+            }
+        }
+
+        /**
+         * @return the position in the string key that the tea key for a
+         * block starts at; each block moves 16 characters along
+         */
+        inline std::string::size_type keyIndexForBlock(std::string const &key, uint64_t const blockIndex)
+        {
+            return key.empty() ? 0 : static_cast<std::string::size_type>((blockIndex * 16) % key.length());
+        }
+
+        /**
+         * @brief computes the 2 * rounds round keys (sum + key[...]) which
+         * XTEA mixes in to the block whose tea key starts at keyIndex
+         */
+        inline void expandTeaKey(std::string const &key,
+                                 std::string::size_type const keyIndex,
+                                 int const rounds,
+                                 uint32_t * const words)
+        {
+            uint32_t const delta = 0x9E3779B9;
+            uint32_t teaKey[4];
+            teaKeyAtIndex(key, keyIndex, teaKey);
+            uint32_t sum = 0;
+            for (int i = 0; i < rounds; ++i) {
+                words[2 * i] = sum + teaKey[sum & 3];
+                sum += delta;
+                words[2 * i + 1] = sum + teaKey[(sum >> 11) & 3];
+            }
+        }
+
+        // the xtea encipher algorithm as found on wikipedia, with the round
+        // keys precomputed (see XTEAKeySchedule)
+        inline void encipher(unsigned int num_rounds, uint32_t v[2], uint32_t const *schedule)
+        {
+            uint32_t v0=v[0], v1=v[1];
+            for (unsigned int i=0; i < num_rounds; i++) {
+                v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ schedule[2 * i];
+                v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ schedule[2 * i + 1];
+            }
+            v[0]=v0; v[1]=v1;
+        }
+
+        // the xtea decipher algorithm as found on wikipedia, with the round
+        // keys precomputed (see XTEAKeySchedule)
+        inline void decipher(unsigned int num_rounds, uint32_t v[2], uint32_t const *schedule)
+        {
+            uint32_t v0=v[0], v1=v[1];
+            for (unsigned int i=num_rounds; i > 0; i--) {
+                v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ schedule[2 * i - 1];
+                v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ schedule[2 * i - 2];
+            }
+            v[0]=v0; v[1]=v1;
+        }
+
+        // helper code found here:
+        // http://codereview.stackexchange.com/questions/2050/codereview-tiny-encryption-algorithm-for-arbitrary-sized-data
+        inline void loadBlock(unsigned char const * buffer, uint32_t datablock[2])
+        {
+            datablock[0] = (buffer[0] << 24) | (buffer[1] << 16)  | (buffer[2] << 8) | (buffer[3]);
+            datablock[1] = (buffer[4] << 24) | (buffer[5] << 16)  | (buffer[6] << 8) | (buffer[7]);
+        }
+
+        inline void storeBlock(uint32_t const datablock[2], unsigned char * buffer)
+        {
+            buffer[0] = static_cast<unsigned char>((datablock[0] >> 24) & 0xFF);
+            buffer[1] = static_cast<unsigned char>((datablock[0] >> 16) & 0xFF);
+            buffer[2] = static_cast<unsigned char>((datablock[0] >> 8) & 0xFF);
+            buffer[3] = static_cast<unsigned char>((datablock[0]) & 0xFF);
+            buffer[4] = static_cast<unsigned char>((datablock[1] >> 24) & 0xFF);
+            buffer[5] = static_cast<unsigned char>((datablock[1] >> 16) & 0xFF);
+            buffer[6] = static_cast<unsigned char>((datablock[1] >> 8) & 0xFF);
+            buffer[7] = static_cast<unsigned char>((datablock[1]) & 0xFF);
+        }
+
+        inline void convertBytesAndEncipher(unsigned int num_rounds, unsigned char * buffer, uint32_t const *schedule)
+        {
+            uint32_t datablock[2];
+            loadBlock(buffer, datablock);
+            encipher(num_rounds, datablock, schedule);
+            storeBlock(datablock, buffer);
+        }
+
+        inline void convertBytesAndDecypher(unsigned int num_rounds, unsigned char * buffer, uint32_t const *schedule)
+        {
+            uint32_t datablock[2];
+            loadBlock(buffer, datablock);
+            decipher(num_rounds, datablock, schedule);
+            storeBlock(datablock, buffer);
+        }
+
+    }
+
+    /**
+     * @brief the expanded XTEA key schedule for a string key and number of
+     * rounds. Each 8-byte block takes its tea key from the next 16 characters
+     * of the string key, so the tea keys repeat every
+     * keyLength / gcd(keyLength, 16) blocks. For each block in that cycle the
+     * schedule holds, per round, the two values (sum + key[...]) which XTEA
+     * mixes in, so that no key derivation is left to do per block.
+     */
+    class XTEAKeySchedule
+    {
+
+      public:
+        XTEAKeySchedule(std::string const &key, int const rounds)
+            : m_rounds(rounds)
+            , m_period(period(key))
+            , m_words(static_cast<std::size_t>(m_period) * 2 * rounds)
+        {
+            for (uint32_t block = 0; block < m_period; ++block) {
+                detail::expandTeaKey(key, detail::keyIndexForBlock(key, block), rounds,
+                                     &m_words[static_cast<std::size_t>(block) * 2 * rounds]);
+            }
+        }
+
+        /**
+         * @return the memory that the schedule for a key would take up. This
+         * grows with the length of the key, so for long keys it can be large
+         */
+        static std::size_t bytesFor(std::string const &key, int const rounds)
+        {
+            return static_cast<std::size_t>(period(key)) * 2 * rounds * sizeof(uint32_t);
+        }
+
+        /**
+         * @return the 2 * rounds round keys for the block with the given
+         * index in the stream
+         */
+        uint32_t const *forBlock(uint32_t const blockIndex) const
+        {
+            return &m_words[static_cast<std::size_t>(blockIndex % m_period) * 2 * m_rounds];
+        }
+
+        int rounds() const
+        {
+            return m_rounds;
+        }
+
+        // the memory taken up by the round keys
+        std::size_t bytes() const
+        {
+            return m_words.size() * sizeof(uint32_t);
+        }
+
+      private:
+
+        // the number of blocks after which the tea keys repeat
+        static uint32_t period(std::string const &key)
+        {
+            return key.empty() ? 1 : static_cast<uint32_t>(key.length() / gcd(key.length(), 16));
+        }
+
+        static std::size_t gcd(std::size_t a, std::size_t b)
+        {
+            while (b != 0) {
+                std::size_t const t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+        int const m_rounds;
+        uint32_t const m_period;
+        std::vector<uint32_t> m_words;
+    };
+
+    typedef boost::shared_ptr<XTEAKeySchedule const> SharedKeySchedule;
+
+    /**
+     * @brief the round keys that an XTEAEncryptor or XTEADecryptor works
+     * from. These either come from a (possibly shared) XTEAKeySchedule or,
+     * when the schedule for the key would be large, are derived afresh for
+     * each block, so that an encryptor's memory use doesn't grow with the
+     * length of its key. Unlike an XTEAKeySchedule, this mustn't be used by
+     * several threads at once.
+     */
+    class XTEARoundKeys
+    {
+
+      public:
+        // keys whose schedule would take up more than this are derived per block
+        static std::size_t const MAX_PRIVATE_SCHEDULE_BYTES = 16 * 1024;
+
+        XTEARoundKeys(std::string const &key, int const rounds)
+            : m_rounds(rounds)
+        {
+            if (XTEAKeySchedule::bytesFor(key, rounds) <= MAX_PRIVATE_SCHEDULE_BYTES) {
+                m_schedule = boost::make_shared<XTEAKeySchedule>(key, rounds);
+            } else {
+                m_key = key;
+                m_blockKeys.resize(static_cast<std::size_t>(2) * rounds);
+            }
+        }
+
+        /**
+         * @param schedule an already expanded schedule, e.g. as shared
+         * through an XTEAKeyScheduleCache
+         */
+        XTEARoundKeys(SharedKeySchedule const &schedule)
+            : m_schedule(schedule)
+            , m_rounds(schedule->rounds())
+        {}
+
+        /**
+         * @return the 2 * rounds round keys for the block with the given
+         * index in the stream. When derived per block, these are only valid
+         * until the next call
+         */
+        uint32_t const *forBlock(uint32_t const blockIndex) const
+        {
+            if (m_schedule) {
+                return m_schedule->forBlock(blockIndex);
+            }
+            detail::expandTeaKey(m_key, detail::keyIndexForBlock(m_key, blockIndex), m_rounds, &m_blockKeys[0]);
+            return &m_blockKeys[0];
+        }
+
+        int rounds() const
+        {
+            return m_rounds;
+        }
+
+      private:
+
+        SharedKeySchedule m_schedule;
+        int m_rounds;
+
+        // the key and scratch space for the round keys of one block, when
+        // there is no schedule
+        std::string m_key;
+        mutable std::vector<uint32_t> m_blockKeys;
+    };
+
+}
+
+#endif // XTEA_KEY_SCHEDULE_HPP__
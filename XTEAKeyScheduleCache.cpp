@@ -0,0 +1,130 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "XTEAKeyScheduleCache.hpp"
+
+#include <boost/make_shared.hpp>
+
+namespace cryptex
+{
+
+    XTEAKeyScheduleCache::XTEAKeyScheduleCache(std::size_t const maxBytes)
+        : m_maxBytes(maxBytes)
+        , m_bytes(0)
+        , m_hits(0)
+        , m_misses(0)
+        , m_evictions(0)
+    {}
+
+    SharedKeySchedule
+    XTEAKeyScheduleCache::get(std::string const &key, int const rounds)
+    {
+        CacheKey const cacheKey(key, rounds);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            boost::unordered_map<CacheKey, Entries::iterator>::iterator found = m_index.find(cacheKey);
+            if (found != m_index.end()) {
+                ++m_hits;
+                m_entries.splice(m_entries.begin(), m_entries, found->second);
+                return found->second->second;
+            }
+            ++m_misses;
+        }
+
+        //
+        // expand the key without holding the lock so that lookups of other
+        // keys aren't held up. Another thread may have done the same in the
+        // meantime, in which case its schedule is the one that gets kept
+        //
+        SharedKeySchedule const schedule = boost::make_shared<XTEAKeySchedule>(key, rounds);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        boost::unordered_map<CacheKey, Entries::iterator>::iterator found = m_index.find(cacheKey);
+        if (found != m_index.end()) {
+            m_entries.splice(m_entries.begin(), m_entries, found->second);
+            return found->second->second;
+        }
+        m_entries.push_front(Entry(cacheKey, schedule));
+        m_index[cacheKey] = m_entries.begin();
+        m_bytes += entryBytes(m_entries.front());
+        evictWhilstTooBig();
+        return schedule;
+    }
+
+    unsigned long
+    XTEAKeyScheduleCache::hits() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    unsigned long
+    XTEAKeyScheduleCache::misses() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+    unsigned long
+    XTEAKeyScheduleCache::evictions() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_evictions;
+    }
+
+    std::size_t
+    XTEAKeyScheduleCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    std::size_t
+    XTEAKeyScheduleCache::bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    std::size_t
+    XTEAKeyScheduleCache::entryBytes(Entry const &entry)
+    {
+        return entry.second->bytes() + entry.first.first.size();
+    }
+
+    void
+    XTEAKeyScheduleCache::evictWhilstTooBig()
+    {
+        while (m_bytes > m_maxBytes && !m_entries.empty()) {
+            Entry const &oldest = m_entries.back();
+            m_bytes -= entryBytes(oldest);
+            m_index.erase(oldest.first);
+            m_entries.pop_back();
+            ++m_evictions;
+        }
+    }
+
+    XTEAKeyScheduleCache::~XTEAKeyScheduleCache()
+    {
+    }
+
+}
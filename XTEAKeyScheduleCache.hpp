@@ -0,0 +1,105 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef XTEA_KEY_SCHEDULE_CACHE_HPP__
+#define XTEA_KEY_SCHEDULE_CACHE_HPP__
+
+#include "XTEAKeySchedule.hpp"
+
+#include <boost/unordered_map.hpp>
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace cryptex
+{
+
+    /**
+     * @brief a thread-safe, least recently used cache of expanded XTEA key
+     * schedules, keyed by string key and number of rounds. Useful when
+     * many streams are encrypted with a large but recurring set of keys:
+     * each XTEAEncryptor or XTEADecryptor can be constructed from a schedule
+     * obtained here instead of expanding the key itself.
+     * @note schedules that are evicted remain valid for as long as an
+     * encryptor still refers to them
+     */
+    class XTEAKeyScheduleCache
+    {
+
+      public:
+
+        /**
+         * @param maxBytes the memory that cached schedules may take up before
+         * the least recently used ones are evicted
+         */
+        explicit XTEAKeyScheduleCache(std::size_t const maxBytes);
+
+        /**
+         * @return the schedule for the given key and rounds, expanding it
+         * and adding it to the cache if it isn't already there
+         */
+        SharedKeySchedule get(std::string const &key, int const rounds);
+
+        // the number of lookups that were found in and missing from the cache
+        unsigned long hits() const;
+        unsigned long misses() const;
+
+        // the number of schedules evicted to stay within maxBytes
+        unsigned long evictions() const;
+
+        // the number of schedules cached and the memory they take up
+        std::size_t size() const;
+        std::size_t bytes() const;
+
+        ~XTEAKeyScheduleCache();
+
+      private:
+
+        XTEAKeyScheduleCache(); // no impl required
+        XTEAKeyScheduleCache(XTEAKeyScheduleCache const &); // no impl required
+        XTEAKeyScheduleCache &operator=(XTEAKeyScheduleCache const &); // no impl required
+
+        typedef std::pair<std::string, int> CacheKey;
+        typedef std::pair<CacheKey, SharedKeySchedule> Entry;
+
+        // most recently used at the front
+        typedef std::list<Entry> Entries;
+
+        static std::size_t entryBytes(Entry const &entry);
+        void evictWhilstTooBig();
+
+        std::size_t const m_maxBytes;
+        mutable std::mutex m_mutex;
+        Entries m_entries;
+        boost::unordered_map<CacheKey, Entries::iterator> m_index;
+        std::size_t m_bytes;
+        unsigned long m_hits;
+        unsigned long m_misses;
+        unsigned long m_evictions;
+    };
+
+}
+
+#endif // XTEA_KEY_SCHEDULE_CACHE_HPP__
@@ -0,0 +1,177 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef XXTEA_CHUNK_HPP__
+#define XXTEA_CHUNK_HPP__
+
+#include "XTEAKeySchedule.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <stdint.h>
+
+namespace cryptex
+{
+
+    namespace detail
+    {
+
+        uint32_t const XXTEA_DELTA = 0x9E3779B9;
+
+        inline uint32_t mx(uint32_t const y, uint32_t const z, uint32_t const sum,
+                           unsigned int const p, unsigned int const e, uint32_t const key[4])
+        {
+            return (((z >> 5 ^ y << 2) + (y >> 3 ^ z << 4)) ^ ((sum ^ y) + (key[(p & 3) ^ e] ^ z)));
+        }
+
+        // the xxtea (corrected block tea) encipher algorithm as found on
+        // wikipedia. The n words are treated as one block and go through
+        // 6 + 52 / n cycles
+        inline void encipherChunk(uint32_t * const v, unsigned int const n, uint32_t const key[4])
+        {
+            unsigned int rounds = 6 + 52 / n;
+            uint32_t sum = 0, y, z = v[n - 1];
+            do {
+                sum += XXTEA_DELTA;
+                unsigned int const e = (sum >> 2) & 3;
+                unsigned int p;
+                for (p = 0; p < n - 1; p++) {
+                    y = v[p + 1];
+                    z = v[p] += mx(y, z, sum, p, e, key);
+                }
+                y = v[0];
+                z = v[n - 1] += mx(y, z, sum, p, e, key);
+            } while (--rounds);
+        }
+
+        // the xxtea decipher algorithm as found on wikipedia
+        inline void decipherChunk(uint32_t * const v, unsigned int const n, uint32_t const key[4])
+        {
+            unsigned int rounds = 6 + 52 / n;
+            uint32_t sum = rounds * XXTEA_DELTA, y = v[0], z;
+            do {
+                unsigned int const e = (sum >> 2) & 3;
+                unsigned int p;
+                for (p = n - 1; p > 0; p--) {
+                    z = v[p - 1];
+                    y = v[p] -= mx(y, z, sum, p, e, key);
+                }
+                z = v[n - 1];
+                y = v[0] -= mx(y, z, sum, p, e, key);
+                sum -= XXTEA_DELTA;
+            } while (--rounds);
+        }
+
+        /**
+         * @brief enciphers or deciphers a whole number of 4-byte words held
+         * in buffer, in place. The bytes are turned in to little endian words
+         * in the same storage, so no scratch space is needed
+         * @param buffer must be aligned for uint32_t, as PooledBuffers are
+         */
+        inline void convertBytesAndTransformChunk(bool const encrypting,
+                                                  unsigned char * const buffer,
+                                                  std::size_t const bytes,
+                                                  uint32_t const key[4])
+        {
+            std::size_t const n = bytes / 4;
+            uint32_t * const words = reinterpret_cast<uint32_t*>(buffer);
+            for (std::size_t i = 0; i < n; ++i) {
+                unsigned char const * const b = buffer + 4 * i;
+                words[i] = b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+            }
+            if (encrypting) {
+                encipherChunk(words, n, key);
+            } else {
+                decipherChunk(words, n, key);
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                uint32_t const word = words[i];
+                unsigned char * const b = buffer + 4 * i;
+                b[0] = static_cast<unsigned char>(word & 0xFF);
+                b[1] = static_cast<unsigned char>((word >> 8) & 0xFF);
+                b[2] = static_cast<unsigned char>((word >> 16) & 0xFF);
+                b[3] = static_cast<unsigned char>((word >> 24) & 0xFF);
+            }
+        }
+
+        // mixes a further 4 words in to a 128-bit key, Davies-Meyer style,
+        // using the XXTEA cipher itself as the compression function
+        inline void foldInToKey(uint32_t teaKey[4], uint32_t const words[4])
+        {
+            uint32_t v[4] = { teaKey[0], teaKey[1], teaKey[2], teaKey[3] };
+            encipherChunk(v, 4, words);
+            for (int i = 0; i < 4; ++i) {
+                teaKey[i] ^= v[i];
+            }
+        }
+
+        /**
+         * @brief derives the 128-bit XXTEA key from a string key. Keys of up
+         * to 16 characters are used as they are (repeated if shorter); every
+         * character of a longer key, along with its length, is folded in
+         * to it so that none of the key goes unused
+         */
+        inline void xxteaKey(std::string const &key, uint32_t teaKey[4])
+        {
+            teaKeyAtIndex(key, 0, teaKey);
+            if (key.length() <= 16) {
+                return;
+            }
+            for (std::string::size_type i = 16; i < key.length(); i += 16) {
+                uint32_t words[4] = { 0, 0, 0, 0 };
+                std::memcpy(words, key.data() + i, std::min<std::string::size_type>(16, key.length() - i));
+                foldInToKey(teaKey, words);
+            }
+            uint64_t const length = key.length();
+            uint32_t const lengthWords[4] = { static_cast<uint32_t>(length), static_cast<uint32_t>(length >> 32), 0, 0 };
+            foldInToKey(teaKey, lengthWords);
+        }
+
+        /**
+         * @brief derives the key for one chunk by folding the chunk's index
+         * in to the 128-bit key, so that identical chunks encipher
+         * differently and chunks can't be reordered without being noticed
+         */
+        inline void chunkKey(uint32_t const teaKey[4], uint32_t const index, uint32_t key[4])
+        {
+            std::copy(teaKey, teaKey + 4, key);
+            uint32_t const indexWords[4] = { index, 0, 0, 0 };
+            foldInToKey(key, indexWords);
+        }
+
+        inline std::size_t checkedChunkSize(std::size_t const chunkSize)
+        {
+            if (chunkSize < 8 || chunkSize % 4 != 0) {
+                throw std::invalid_argument("cryptex: XXTEA chunk size must be a multiple of 4 of at least 8");
+            }
+            return chunkSize;
+        }
+
+    }
+
+}
+
+#endif // XXTEA_CHUNK_HPP__
@@ -0,0 +1,157 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef I_ENCRYPTOR_XXTEA_DECRYPTOR_HPP__
+#define I_ENCRYPTOR_XXTEA_DECRYPTOR_HPP__
+
+#include "BufferPool.hpp"
+#include "IEncryptor.hpp"
+#include "XXTEAChunk.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace cryptex
+{
+
+    /**
+     * @brief decrypts data encrypted by an XXTEAEncryptor with the same key
+     * and chunk size
+     */
+    class XXTEADecryptor : public IEncryptor
+    {
+
+      public:
+        XXTEADecryptor(std::string const &key, std::size_t const chunkSize)
+            : IEncryptor(key)
+            , m_chunkSize(detail::checkedChunkSize(chunkSize))
+            , m_chunk(BufferPool::shared().borrow(m_chunkSize + 9))
+            , m_bytesInChunk(0)
+            , m_chunkIndex(0)
+            , m_dataWrittenSoFar(0)
+        {
+            detail::xxteaKey(key, m_teaKey);
+        }
+
+        /**
+         * @brief non-virtual versions of IEncryptor::encrypt and IEncryptor::finish
+         * for use with a StaticEncryptionSink
+         */
+        void encrypt(unsigned char byte, std::ostream &out, bool const lastByte = false) const
+        {
+            XXTEADecryptor::doCryptTransform(byte, key(), out, lastByte);
+        }
+
+        void finish(std::ostream &out) const
+        {
+            XXTEADecryptor::doFinish(key(), out);
+        }
+
+      private:
+
+        // the number of bytes in each full chunk
+        std::size_t const m_chunkSize;
+
+        // the 128-bit key derived from the whole string key
+        uint32_t m_teaKey[4];
+
+        // ciphertext waiting to be deciphered, borrowed from the shared
+        // buffer pool
+        mutable PooledBuffer m_chunk;
+        mutable std::size_t m_bytesInChunk;
+
+        // the position of the current chunk in the stream, folded in to
+        // its key
+        mutable uint32_t m_chunkIndex;
+
+        // the number of data bytes written out from the full chunks, to be
+        // checked against the overall length in the trailer
+        mutable uint32_t m_dataWrittenSoFar;
+
+        /**
+         * @brief adds a byte to the current chunk
+         * @note the last chunk is at most chunkSize + 8 bytes long, so once
+         * more bytes than that have built up, the first chunkSize of them must
+         * be a full chunk and can be deciphered. Whatever is left when
+         * finish is called is the last chunk
+         */
+        void doCryptTransform(unsigned char byte, std::string const &, std::ostream &out, bool) const
+        {
+            m_chunk.data()[m_bytesInChunk++] = byte;
+            if (m_bytesInChunk == m_chunkSize + 9) {
+                transformChunk(m_chunkSize);
+                out.write(reinterpret_cast<char*>(m_chunk.data()), m_chunkSize);
+                m_dataWrittenSoFar += m_chunkSize;
+                std::memmove(m_chunk.data(), m_chunk.data() + m_chunkSize, 9);
+                m_bytesInChunk = 9;
+            }
+        }
+
+        /**
+         * @brief deciphers the last chunk and writes out the data bytes that
+         * its trailer says it holds
+         * @note throws std::runtime_error if the trailer doesn't agree with
+         * the amount of ciphertext, as happens when the key is wrong or the
+         * data has been cut short or corrupted
+         */
+        void doFinish(std::string const &, std::ostream &out) const
+        {
+            if (m_bytesInChunk < 8 || m_bytesInChunk % 4 != 0) {
+                throw std::runtime_error("cryptex: truncated or corrupt XXTEA ciphertext");
+            }
+            transformChunk(m_bytesInChunk);
+            uint32_t const leftOver = readWord(m_chunk.data() + m_bytesInChunk - 8);
+            uint32_t const dataLength = readWord(m_chunk.data() + m_bytesInChunk - 4);
+
+            //
+            // the left over bytes must fill all but the padding of the chunk,
+            // and only empty data has none
+            //
+            if ((static_cast<std::size_t>(leftOver) + 3) / 4 * 4 != m_bytesInChunk - 8 ||
+                (leftOver == 0 && dataLength != 0) ||
+                dataLength != m_dataWrittenSoFar + leftOver) {
+                throw std::runtime_error("cryptex: wrong key or corrupt XXTEA ciphertext");
+            }
+            out.write(reinterpret_cast<char*>(m_chunk.data()), leftOver);
+            m_bytesInChunk = 0;
+            m_chunkIndex = 0;
+        }
+
+        static uint32_t readWord(unsigned char const * const b)
+        {
+            return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+        }
+
+        void transformChunk(std::size_t const bytes) const
+        {
+            uint32_t key[4];
+            detail::chunkKey(m_teaKey, m_chunkIndex++, key);
+            detail::convertBytesAndTransformChunk(false, m_chunk.data(), bytes, key);
+        }
+
+    };
+
+}
+
+#endif
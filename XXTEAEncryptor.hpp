@@ -0,0 +1,156 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#ifndef I_ENCRYPTOR_XXTEA_ENCRYPTOR_HPP__
+#define I_ENCRYPTOR_XXTEA_ENCRYPTOR_HPP__
+
+#include "BufferPool.hpp"
+#include "IEncryptor.hpp"
+#include "XXTEAChunk.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace cryptex
+{
+
+    /**
+     * @brief encrypts with XXTEA (corrected block tea). Rather than working
+     * on 8-byte blocks, the data is split in to large chunks, each of which
+     * is enciphered as a single block. XXTEA's number of cycles falls as the
+     * block grows (6 + 52 / n for n words), so large chunks take far less
+     * work per byte than XTEA does.
+     * The last chunk holds whatever data is left over (at least 1 byte unless
+     * the data is empty), zero padded to a whole number of 4-byte words and
+     * followed by an 8-byte trailer giving the number of data bytes in that
+     * chunk and the overall data length. A stream therefore consists of
+     * zero or more full chunks of chunkSize bytes followed by a last chunk of
+     * between 8 and chunkSize + 8 bytes. Each chunk is enciphered with its
+     * own key, derived from the chunk's index (see detail::chunkKey).
+     */
+    class XXTEAEncryptor : public IEncryptor
+    {
+
+      public:
+        /**
+         * @param key the key to encrypt with. A key of up to 16 characters
+         * (repeated if it is shorter) makes up the 128-bit XXTEA key; longer
+         * keys are folded down to 128 bits (see detail::xxteaKey)
+         * @param chunkSize the number of bytes in each chunk, a multiple of 4
+         * of at least 8. Something in the range of 4 KiB to 1 MiB is sensible
+         */
+        XXTEAEncryptor(std::string const &key, std::size_t const chunkSize)
+            : IEncryptor(key)
+            , m_chunkSize(detail::checkedChunkSize(chunkSize))
+            , m_chunk(BufferPool::shared().borrow(m_chunkSize + 8))
+            , m_bytesInChunk(0)
+            , m_chunkIndex(0)
+            , m_origDataLength(0)
+        {
+            detail::xxteaKey(key, m_teaKey);
+        }
+
+        /**
+         * @brief non-virtual versions of IEncryptor::encrypt and IEncryptor::finish
+         * for use with a StaticEncryptionSink
+         */
+        void encrypt(unsigned char byte, std::ostream &out, bool const lastByte = false) const
+        {
+            XXTEAEncryptor::doCryptTransform(byte, key(), out, lastByte);
+        }
+
+        void finish(std::ostream &out) const
+        {
+            XXTEAEncryptor::doFinish(key(), out);
+        }
+
+      private:
+
+        // the number of bytes in each full chunk
+        std::size_t const m_chunkSize;
+
+        // the 128-bit key derived from the whole string key
+        uint32_t m_teaKey[4];
+
+        // data waiting to be enciphered, borrowed from the shared buffer pool
+        mutable PooledBuffer m_chunk;
+        mutable std::size_t m_bytesInChunk;
+
+        // the position of the current chunk in the stream, folded in to
+        // its key
+        mutable uint32_t m_chunkIndex;
+
+        // the length of the unencrypted data, recorded in the trailer
+        mutable uint32_t m_origDataLength;
+
+        /**
+         * @brief adds a byte to the current chunk. A chunk is only enciphered
+         * once the first byte beyond it arrives, so that the last chunk is
+         * never empty and can always be told apart from the full chunks
+         */
+        void doCryptTransform(unsigned char byte, std::string const &, std::ostream &out, bool) const
+        {
+            m_chunk.data()[m_bytesInChunk++] = byte;
+            ++m_origDataLength;
+            if (m_bytesInChunk == m_chunkSize + 1) {
+                transformChunk(m_chunkSize);
+                out.write(reinterpret_cast<char*>(m_chunk.data()), m_chunkSize);
+                m_chunk.data()[0] = m_chunk.data()[m_chunkSize];
+                m_bytesInChunk = 1;
+            }
+        }
+
+        /**
+         * @brief pads out the left over bytes to whole words, adds the trailer
+         * and enciphers them as the last chunk
+         */
+        void doFinish(std::string const &, std::ostream &out) const
+        {
+            uint32_t const leftOver = m_bytesInChunk;
+            while (m_bytesInChunk % 4 != 0) {
+                m_chunk.data()[m_bytesInChunk++] = 0;
+            }
+            uint32_t const trailer[2] = { leftOver, m_origDataLength };
+            for (int i = 0; i < 2; ++i) {
+                m_chunk.data()[m_bytesInChunk++] = static_cast<unsigned char>(trailer[i] & 0xFF);
+                m_chunk.data()[m_bytesInChunk++] = static_cast<unsigned char>((trailer[i] >> 8) & 0xFF);
+                m_chunk.data()[m_bytesInChunk++] = static_cast<unsigned char>((trailer[i] >> 16) & 0xFF);
+                m_chunk.data()[m_bytesInChunk++] = static_cast<unsigned char>((trailer[i] >> 24) & 0xFF);
+            }
+            transformChunk(m_bytesInChunk);
+            out.write(reinterpret_cast<char*>(m_chunk.data()), m_bytesInChunk);
+            m_bytesInChunk = 0;
+            m_chunkIndex = 0;
+        }
+
+        void transformChunk(std::size_t const bytes) const
+        {
+            uint32_t key[4];
+            detail::chunkKey(m_teaKey, m_chunkIndex++, key);
+            detail::convertBytesAndTransformChunk(true, m_chunk.data(), bytes, key);
+        }
+
+    };
+
+}
+
+#endif
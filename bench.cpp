@@ -0,0 +1,593 @@
+/* The MIT License (MIT)
+
+Copyright (c) <2013> <Ben H.D. Jones>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.*/
+
+#include "BufferPool.hpp"
+#include "EncryptionSink.hpp"
+#include "FanOutSink.hpp"
+#include "MessageChannel.hpp"
+#include "Rekey.hpp"
+#include "StaticEncryptionSink.hpp"
+#include "XTEAEncryptor.hpp"
+#include "XTEADecryptor.hpp"
+#include "XTEAKeyScheduleCache.hpp"
+#include "XXTEAEncryptor.hpp"
+#include "XXTEADecryptor.hpp"
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/null.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/make_shared.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace cryptex;
+
+typedef std::vector<char> Data;
+typedef std::chrono::steady_clock Clock;
+
+std::string const KEY("a benchmark key of some length");
+
+Data randomData(unsigned long const bytes)
+{
+    Data data(bytes);
+    std::srand(1234);
+    for (unsigned long i = 0; i < bytes; ++i) {
+        data[i] = static_cast<char>(std::rand());
+    }
+    return data;
+}
+
+double secondsSince(Clock::time_point const &start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(std::string const &name, unsigned long const bytes, double const seconds)
+{
+    std::cout<<name<<": "<<(bytes / (1024.0 * 1024.0)) / seconds<<" MiB/s"<<std::endl;
+}
+
+// Writes plain through any sink type, returning the time taken
+template <typename Sink>
+double timeSink(Data const &plain, Sink const &sink)
+{
+    Clock::time_point const start = Clock::now();
+    boost::iostreams::stream<Sink> cipherStream(sink);
+    cipherStream.write(&plain.front(), plain.size());
+    cipherStream.flush();
+    return secondsSince(start);
+}
+
+// Compares the virtually dispatched EncryptionSink with StaticEncryptionSink
+void benchSinks(Data const &plain)
+{
+    // room for the padding and length blocks
+    Data dynamicOut(plain.size() + 16);
+    Data staticOut(plain.size() + 16);
+
+    boost::iostreams::stream<boost::iostreams::array_sink> dynamicStream(&dynamicOut.front(), dynamicOut.size());
+    EncryptionSink::SharedEncryptor enc = boost::make_shared<XTEAEncryptor>(KEY, 64);
+    EncryptionSink dynamicSink(dynamicStream, plain.size(), enc);
+    report("EncryptionSink<IEncryptor> (virtual)", plain.size(), timeSink(plain, dynamicSink));
+
+    boost::iostreams::stream<boost::iostreams::array_sink> staticStream(&staticOut.front(), staticOut.size());
+    StaticEncryptionSink<XTEAEncryptor> staticSink(staticStream, plain.size(), XTEAEncryptor(KEY, 64));
+    report("StaticEncryptionSink<XTEAEncryptor>", plain.size(), timeSink(plain, staticSink));
+
+    dynamicStream.flush();
+    staticStream.flush();
+    if (dynamicOut != staticOut) {
+        std::cout<<"ERROR: sink outputs differ"<<std::endl;
+    }
+}
+
+MessageChannel::SharedEncryptor makeXTEAEncryptor()
+{
+    return boost::make_shared<XTEAEncryptor>(KEY, 64);
+}
+
+MessageChannel::SharedEncryptor makeXTEADecryptor()
+{
+    return boost::make_shared<XTEADecryptor>(KEY, 64);
+}
+
+// Measures round trip latency and one-way throughput of MessageChannel
+// over a local socketpair
+void benchChannel()
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cout<<"ERROR: socketpair failed"<<std::endl;
+        return;
+    }
+    MessageChannel near(fds[0], makeXTEAEncryptor, makeXTEADecryptor);
+    MessageChannel far(fds[1], makeXTEAEncryptor, makeXTEADecryptor);
+
+    // ping pong of small messages; the far end echoes everything back
+    // until the empty message
+    int const roundTrips = 10000;
+    std::string const ping(64, 'p');
+    std::thread echo([&far]() {
+        std::string message;
+        while (far.receive(message) && !message.empty()) {
+            far.send(message);
+        }
+    });
+    std::string pong;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < roundTrips; ++i) {
+        near.send(ping);
+        near.receive(pong);
+    }
+    double const seconds = secondsSince(start);
+    if (pong != ping) {
+        std::cout<<"ERROR: echoed message differs"<<std::endl;
+    }
+    near.send(std::string());
+    echo.join();
+    std::cout<<"MessageChannel round trip (64 byte messages): "
+             <<(seconds / roundTrips) * 1e6<<" us"<<std::endl;
+
+    // one-way streams of small messages, sent one syscall per message and
+    // then batched by posting and flushing every so often
+    int const messages = 100000;
+    std::string const payload(256, 'x');
+    for (int batched = 0; batched < 2; ++batched) {
+        unsigned long received = 0;
+        std::thread sink([&far, &received]() {
+            std::string message;
+            while (far.receive(message) && !message.empty()) {
+                received += message.size();
+            }
+        });
+        start = Clock::now();
+        for (int i = 0; i < messages; ++i) {
+            if (batched) {
+                near.post(payload);
+                if (i % 64 == 63) {
+                    near.flush();
+                }
+            } else {
+                near.send(payload);
+            }
+        }
+        near.send(std::string());
+        sink.join();
+        double const taken = secondsSince(start);
+        std::cout<<"MessageChannel "<<(batched ? "post/flush" : "send")<<" (256 byte messages): "
+                 <<messages / taken<<" msgs/s, "
+                 <<(received / (1024.0 * 1024.0)) / taken<<" MiB/s"<<std::endl;
+    }
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+MessageChannel::SharedEncryptor makeOtherKeyEncryptor()
+{
+    return boost::make_shared<XTEAEncryptor>("not the benchmark key", 64);
+}
+
+// Whether receiving from a channel throws
+bool receiveFails(MessageChannel &channel)
+{
+    std::string message;
+    try {
+        channel.receive(message);
+    } catch (std::runtime_error const &) {
+        return true;
+    }
+    return false;
+}
+
+// Checks that MessageChannel rejects malformed frames: junk and frames
+// sent under another key fail to decrypt but leave the channel usable,
+// whilst oversized frames and frames that aren't whole blocks are
+// rejected from their header alone
+void checkMalformedFrames()
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cout<<"ERROR: socketpair failed"<<std::endl;
+        return;
+    }
+    MessageChannel near(fds[0], makeXTEAEncryptor, makeXTEADecryptor);
+    MessageChannel far(fds[1], makeXTEAEncryptor, makeXTEADecryptor);
+    MessageChannel otherKey(fds[1], makeOtherKeyEncryptor, makeXTEADecryptor);
+
+    char const junk[] = { 8, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    if (::write(fds[1], junk, sizeof(junk)) != static_cast<ssize_t>(sizeof(junk))) {
+        std::cout<<"ERROR: write failed"<<std::endl;
+    }
+    otherKey.send("sent under another key");
+    far.send("still readable");
+    bool const junkFailed = receiveFails(near);
+    bool const otherKeyFailed = receiveFails(near);
+    std::string message;
+    bool const recovered = near.receive(message) && message == "still readable";
+
+    char const partBlock[] = { 5, 0, 0, 0, 1, 2, 3, 4, 5 };
+    if (::write(fds[1], partBlock, sizeof(partBlock)) != static_cast<ssize_t>(sizeof(partBlock))) {
+        std::cout<<"ERROR: write failed"<<std::endl;
+    }
+    bool const partBlockFailed = receiveFails(near);
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cout<<"ERROR: socketpair failed"<<std::endl;
+        return;
+    }
+    MessageChannel limited(fds[0], makeXTEAEncryptor, makeXTEADecryptor);
+    char const huge[] = { -1, -1, -1, -1 };
+    if (::write(fds[1], huge, sizeof(huge)) != static_cast<ssize_t>(sizeof(huge))) {
+        std::cout<<"ERROR: write failed"<<std::endl;
+    }
+    bool const hugeFailed = receiveFails(limited);
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    if (!junkFailed || !otherKeyFailed || !recovered || !partBlockFailed || !hugeFailed) {
+        std::cout<<"ERROR: malformed frame accepted"<<std::endl;
+    } else {
+        std::cout<<"MessageChannel: malformed frames rejected"<<std::endl;
+    }
+}
+
+// Compares XTEA with XXTEA over a range of chunk sizes
+void benchXXTEA(Data const &plain)
+{
+    Data cipherText(plain.size() + 16);
+    {
+        boost::iostreams::stream<boost::iostreams::array_sink> out(&cipherText.front(), cipherText.size());
+        StaticEncryptionSink<XTEAEncryptor> sink(out, plain.size(), XTEAEncryptor(KEY, 64));
+        report("XTEA (64 rounds)", plain.size(), timeSink(plain, sink));
+    }
+
+    std::size_t const chunkSizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+    for (int i = 0; i < 3; ++i) {
+        std::ostringstream name;
+        name<<"XXTEA ("<<chunkSizes[i] / 1024<<" KiB chunks)";
+        boost::iostreams::stream<boost::iostreams::array_sink> out(&cipherText.front(), cipherText.size());
+        StaticEncryptionSink<XXTEAEncryptor> sink(out, plain.size(), XXTEAEncryptor(KEY, chunkSizes[i]));
+        report(name.str(), plain.size(), timeSink(plain, sink));
+        out.flush();
+
+        // the ciphertext size is the data size rounded up to whole words
+        // plus the 8-byte trailer
+        std::size_t const cipherSize = (plain.size() + 3) / 4 * 4 + 8;
+        Data decrypted(plain.size());
+        boost::iostreams::stream<boost::iostreams::array_sink> back(&decrypted.front(), decrypted.size());
+        StaticEncryptionSink<XXTEADecryptor> decryptSink(back, cipherSize, XXTEADecryptor(KEY, chunkSizes[i]));
+        Data const encrypted(cipherText.begin(), cipherText.begin() + cipherSize);
+        report(name.str() + " decrypt", plain.size(), timeSink(encrypted, decryptSink));
+        back.flush();
+        if (decrypted != plain) {
+            std::cout<<"ERROR: XXTEA round trip failed"<<std::endl;
+        }
+    }
+}
+
+// Runs bytes through an XXTEA encryptor or decryptor byte by byte
+template <typename Encryptor>
+std::string transformXXTEA(Encryptor const &enc, std::string const &in)
+{
+    std::ostringstream out;
+    for (std::string::size_type i = 0; i < in.size(); ++i) {
+        enc.encrypt(static_cast<unsigned char>(in[i]), out);
+    }
+    enc.finish(out);
+    return out.str();
+}
+
+// Checks that XXTEA chunks holding the same data encipher differently and
+// that swapping two chunks around stops the data from decrypting
+void checkReorderedChunks()
+{
+    std::size_t const chunkSize = 4096;
+    std::string const plain(3 * chunkSize + 100, 'x');
+    std::string cipherText = transformXXTEA(XXTEAEncryptor(KEY, chunkSize), plain);
+    bool const chunksDiffer = cipherText.compare(0, chunkSize, cipherText, chunkSize, chunkSize) != 0;
+
+    std::string const first = cipherText.substr(0, chunkSize);
+    cipherText.replace(0, chunkSize, cipherText, chunkSize, chunkSize);
+    cipherText.replace(chunkSize, chunkSize, first);
+    bool reorderedDecrypts;
+    try {
+        reorderedDecrypts = transformXXTEA(XXTEADecryptor(KEY, chunkSize), cipherText) == plain;
+    } catch (std::runtime_error const &) {
+        reorderedDecrypts = false;
+    }
+
+    if (!chunksDiffer || reorderedDecrypts) {
+        std::cout<<"ERROR: XXTEA chunks encipher alike or decrypt out of order"<<std::endl;
+    } else {
+        std::cout<<"XXTEA: identical chunks differ, reordered chunks rejected"<<std::endl;
+    }
+}
+
+// Compares borrowing and returning buffers through a BufferPool with
+// allocating and freeing them, from several threads at once. Each buffer
+// is filled, as a pipeline stage would
+void benchBufferPool()
+{
+    int const threads = 8;
+    int const rounds = 20000;
+    std::size_t const sizes[] = { 1032, 65544, 1048584 };
+    BufferPool pool;
+
+    for (int pooled = 0; pooled < 2; ++pooled) {
+        Clock::time_point const start = Clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.push_back(std::thread([pooled, &pool, &sizes, t]() {
+                for (int i = 0; i < rounds; ++i) {
+                    std::size_t const size = sizes[(i + t) % 3];
+                    if (pooled) {
+                        PooledBuffer buffer = pool.borrow(size);
+                        std::memset(buffer.data(), i, size);
+                    } else {
+                        unsigned char * const buffer = new unsigned char[size];
+                        std::memset(buffer, i, size);
+                        delete [] buffer;
+                    }
+                }
+            }));
+        }
+        for (int t = 0; t < threads; ++t) {
+            workers[t].join();
+        }
+        double const seconds = secondsSince(start);
+        std::cout<<(pooled ? "BufferPool borrow/return: " : "new/delete: ")
+                 <<(threads * rounds) / seconds<<" buffers/s"<<std::endl;
+    }
+
+    BufferPool::Stats const stats = pool.stats();
+    std::cout<<"BufferPool: "<<stats.acquisitions<<" borrowed, reuse rate "<<stats.reuseRate()
+             <<", peak in use "<<stats.peakBytesInUse / 1024<<" KiB"<<std::endl;
+}
+
+// Encrypts a stream with a given encryptor, discarding the output
+template <typename Encryptor>
+void encryptToNowhere(Encryptor const &enc, Data const &plain, std::ostream &out)
+{
+    for (Data::size_type i = 0; i < plain.size(); ++i) {
+        enc.encrypt(static_cast<unsigned char>(plain[i]), out);
+    }
+    enc.finish(out);
+}
+
+// Compares expanding the key for every stream with taking the expanded
+// schedule from an XTEAKeyScheduleCache, for many short streams encrypted
+// with keys drawn from a large set of per-tenant keys
+void benchKeySchedules()
+{
+    int const tenants = 2000;
+    int const streams = 200000;
+    std::vector<std::string> keys;
+    for (int i = 0; i < tenants; ++i) {
+        std::ostringstream key;
+        key<<"tenant key number "<<i;
+        keys.push_back(key.str());
+    }
+    Data const plain = randomData(64);
+    boost::iostreams::stream<boost::iostreams::null_sink> nowhere((boost::iostreams::null_sink()));
+
+    std::srand(42);
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < streams; ++i) {
+        encryptToNowhere(XTEAEncryptor(keys[std::rand() % tenants], 64), plain, nowhere);
+    }
+    double seconds = secondsSince(start);
+    std::cout<<"XTEAEncryptor expanding its own key: "<<streams / seconds<<" streams/s"<<std::endl;
+
+    XTEAKeyScheduleCache cache(16 * 1024 * 1024);
+    std::srand(42);
+    start = Clock::now();
+    for (int i = 0; i < streams; ++i) {
+        std::string const &key = keys[std::rand() % tenants];
+        encryptToNowhere(XTEAEncryptor(key, cache.get(key, 64)), plain, nowhere);
+    }
+    seconds = secondsSince(start);
+    std::cout<<"XTEAEncryptor with XTEAKeyScheduleCache: "<<streams / seconds<<" streams/s ("
+             <<cache.hits()<<" hits, "<<cache.misses()<<" misses, "
+             <<cache.bytes() / 1024<<" KiB cached)"<<std::endl;
+}
+
+// Discards the ciphertext handed to a FanOutSink destination
+void discard(char const *, std::size_t)
+{
+}
+
+// As discard but takes a millisecond over every chunk, as a slow
+// network destination might
+void discardSlowly(char const *, std::size_t)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void reportDestinations(FanOutSink const &sink)
+{
+    std::vector<FanOutSink::DestinationStats> const stats = sink.stats();
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        std::cout<<"  destination "<<i<<": "<<stats[i].bytesPerSecond() / (1024.0 * 1024.0)
+                 <<" MiB/s writing, "<<stats[i].stalls<<" stalls"<<std::endl;
+    }
+}
+
+// Compares encrypting the same data separately for each of three
+// destinations with encrypting it once through a FanOutSink, and shows
+// how a slow destination holds up the encryption
+void benchFanOut(Data const &plain)
+{
+    int const destinations = 3;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < destinations; ++i) {
+        boost::iostreams::stream<boost::iostreams::null_sink> nowhere((boost::iostreams::null_sink()));
+        EncryptionSink sink(nowhere, plain.size(), boost::make_shared<XTEAEncryptor>(KEY, 64));
+        boost::iostreams::stream<EncryptionSink> cipherStream(sink);
+        cipherStream.write(&plain.front(), plain.size());
+        cipherStream.flush();
+    }
+    report("EncryptionSink x 3 destinations", plain.size(), secondsSince(start));
+
+    std::vector<FanOutSink::Destination> fast(destinations, discard);
+    {
+        FanOutSink sink(fast, plain.size(), boost::make_shared<XTEAEncryptor>(KEY, 64));
+        start = Clock::now();
+        {
+            boost::iostreams::stream<FanOutSink> cipherStream(sink);
+            cipherStream.write(&plain.front(), plain.size());
+            cipherStream.flush();
+        }
+        report("FanOutSink to 3 destinations", plain.size(), secondsSince(start));
+        reportDestinations(sink);
+    }
+
+    std::vector<FanOutSink::Destination> oneSlow(fast);
+    oneSlow.back() = discardSlowly;
+    {
+        FanOutSink sink(oneSlow, plain.size(), boost::make_shared<XTEAEncryptor>(KEY, 64));
+        start = Clock::now();
+        {
+            boost::iostreams::stream<FanOutSink> cipherStream(sink);
+            cipherStream.write(&plain.front(), plain.size());
+            cipherStream.flush();
+        }
+        report("FanOutSink to 3 destinations, one slow", plain.size(), secondsSince(start));
+        reportDestinations(sink);
+    }
+}
+
+// Compares re-keying XTEA ciphertext by decrypting it and encrypting the
+// result again in two passes with re-keying it in a single pass, both
+// byte by byte through a decryptor and encryptor and a chunk of blocks at
+// a time, against a single encryption pass
+void benchRekey(Data const &plain)
+{
+    std::string const newKey("the new key, rotated in");
+    Data cipherText(plain.size() + 16);
+    {
+        boost::iostreams::stream<boost::iostreams::array_sink> out(&cipherText.front(), cipherText.size());
+        StaticEncryptionSink<XTEAEncryptor> sink(out, plain.size(), XTEAEncryptor(KEY, 64));
+        report("encrypt (one pass)", plain.size(), timeSink(plain, sink));
+    }
+    std::size_t const cipherSize = (plain.size() + 7) / 8 * 8 + 8;
+    cipherText.resize(cipherSize);
+
+    Data expected(cipherSize);
+    {
+        boost::iostreams::stream<boost::iostreams::array_sink> out(&expected.front(), expected.size());
+        StaticEncryptionSink<XTEAEncryptor> sink(out, plain.size(), XTEAEncryptor(newKey, 64));
+        timeSink(plain, sink);
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        Data decrypted(plain.size());
+        Data reEncrypted(cipherSize);
+        boost::iostreams::stream<boost::iostreams::array_sink> back(&decrypted.front(), decrypted.size());
+        StaticEncryptionSink<XTEADecryptor> decryptSink(back, cipherSize, XTEADecryptor(KEY, 64));
+        timeSink(cipherText, decryptSink);
+        back.flush();
+        boost::iostreams::stream<boost::iostreams::array_sink> out(&reEncrypted.front(), reEncrypted.size());
+        StaticEncryptionSink<XTEAEncryptor> encryptSink(out, plain.size(), XTEAEncryptor(newKey, 64));
+        timeSink(decrypted, encryptSink);
+    }
+    report("decrypt then encrypt (two passes)", plain.size(), secondsSince(start));
+
+    {
+        std::istringstream in(std::string(cipherText.begin(), cipherText.end()));
+        std::ostringstream out;
+        start = Clock::now();
+        rekey(in, out, boost::make_shared<XTEADecryptor>(KEY, 64), boost::make_shared<XTEAEncryptor>(newKey, 64));
+        report("rekey (XTEADecryptor -> XTEAEncryptor)", plain.size(), secondsSince(start));
+        std::string const result = out.str();
+        if (Data(result.begin(), result.end()) != expected) {
+            std::cout<<"ERROR: rekey output differs"<<std::endl;
+        }
+    }
+
+    SharedKeySchedule const from = boost::make_shared<XTEAKeySchedule>(KEY, 64);
+    SharedKeySchedule const to = boost::make_shared<XTEAKeySchedule>(newKey, 64);
+    unsigned const threadCounts[] = { 1, 0 };
+    for (int i = 0; i < 2; ++i) {
+        std::istringstream in(std::string(cipherText.begin(), cipherText.end()));
+        std::ostringstream out;
+        start = Clock::now();
+        rekeyXTEA(in, out, from, to, 4 * 1024 * 1024, threadCounts[i]);
+        report(threadCounts[i] == 1 ? "rekeyXTEA (1 thread)" : "rekeyXTEA (all hardware threads)",
+               plain.size(), secondsSince(start));
+        std::string const result = out.str();
+        if (Data(result.begin(), result.end()) != expected) {
+            std::cout<<"ERROR: rekeyXTEA output differs"<<std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string const which(argc > 1 ? argv[1] : "all");
+    unsigned long const mebibytes = argc > 2 ? std::strtoul(argv[2], 0, 10) : 16;
+
+    // e.g. bench xxtea 16 huge, to back the cipher buffers with huge pages
+    if (argc > 3 && std::string(argv[3]) == "huge") {
+        BufferPool::configureShared(64 * 1024 * 1024, true);
+    }
+    Data const plain = randomData(mebibytes * 1024 * 1024);
+
+    if (which == "all" || which == "sink") {
+        benchSinks(plain);
+    }
+    if (which == "all" || which == "xxtea") {
+        benchXXTEA(plain);
+        checkReorderedChunks();
+    }
+    if (which == "all" || which == "pool") {
+        benchBufferPool();
+    }
+    if (which == "all" || which == "schedule") {
+        benchKeySchedules();
+    }
+    if (which == "all" || which == "rekey") {
+        benchRekey(plain);
+    }
+    if (which == "all" || which == "fanout") {
+        benchFanOut(plain);
+    }
+    if (which == "all" || which == "channel") {
+        benchChannel();
+        checkMalformedFrames();
+    }
+    return 0;
+}
@@ -20,9 +20,15 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.*/
 
+#include "AsyncCrypt.hpp"
 #include "EncryptionSink.hpp"
+#include "FanOutSink.hpp"
+#include "Rekey.hpp"
 #include "XTEAEncryptor.hpp"
 #include "XTEADecryptor.hpp"
+#include "XTEAAppend.hpp"
+#include "XXTEAEncryptor.hpp"
+#include "XXTEADecryptor.hpp"
 
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/stream.hpp>
@@ -31,6 +37,11 @@ THE SOFTWARE.*/
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace cryptex;
 
@@ -82,6 +93,177 @@ void decrypt(char const *fin, char const *fout, std::string const &key)
     boost::iostreams::copy(inFile, cipherStream);
 }
 
+void append(char const *fin, char const *fout, std::string const &key)
+{
+
+    // (i) Create the input stream and open the already encrypted output
+    // stream for both reading and writing
+    std::ifstream inFile(fin, std::ios::in | std::ios::binary);
+    std::fstream cipherFile(fout, std::ios::in | std::ios::out | std::ios::binary);
+
+    // (ii) Resume the encryption algorithm from the tail of the encrypted data
+    EncryptionSink::SharedEncryptor enc = resumeXTEAEncryptor(cipherFile, key, 64);
+
+    // (iii) Create the sink device that we write to and make a stream out of it
+    EncryptionSink sink(cipherFile, getStreamSize(inFile), enc);
+    boost::iostreams::stream<EncryptionSink> cipherStream(sink);
+
+    // (iv) Copy the input stream to the cipher stream. This encrypts the data
+    // and rewrites the length block
+    boost::iostreams::copy(inFile, cipherStream);
+}
+
+void xxtea(char const *fin, char const *fout, std::string const &key, bool const encrypting)
+{
+
+    // (i) Create the input and output streams
+    std::ifstream inFile(fin, std::ios::in | std::ios::binary);
+    std::ofstream testOutput(fout, std::ios::out | std::ios::binary);
+
+    // (ii) Set up XXTEA, working on 64 KiB chunks
+    std::size_t const chunkSize = 64 * 1024;
+    EncryptionSink::SharedEncryptor enc;
+    if (encrypting) {
+        enc = boost::make_shared<XXTEAEncryptor>(key, chunkSize);
+    } else {
+        enc = boost::make_shared<XXTEADecryptor>(key, chunkSize);
+    }
+
+    // (iii) Create the sink device that we write to and make a stream out of it
+    EncryptionSink sink(testOutput, getStreamSize(inFile), enc);
+    boost::iostreams::stream<EncryptionSink> cipherStream(sink);
+
+    // (iv) Copy the input stream to the cipher stream
+    boost::iostreams::copy(inFile, cipherStream);
+}
+
+void asyncEncryptOrDecrypt(char const *fin, char const *fout, std::string const &key, bool const encrypting)
+{
+
+    // (i) Open the input and output files. Since the coroutine reads until
+    // end of file, their sizes don't need to be known
+    int const inFd = ::open(fin, O_RDONLY);
+    int const outFd = ::open(fout, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    // (ii) Set up the encryption algorithm that we wish to use
+    EncryptionSink::SharedEncryptor enc;
+    if (encrypting) {
+        enc = boost::make_shared<XTEAEncryptor>(key, 64);
+    } else {
+        enc = boost::make_shared<XTEADecryptor>(key, 64);
+    }
+
+    // (iii) Run the coroutine on a pool of I/O threads and wait for it
+    ThreadPoolAsyncIO io;
+    syncWait(io, asyncCrypt(io, inFd, outFd, enc));
+
+    ::close(inFd);
+    ::close(outFd);
+}
+
+void pipedEncryptOrDecrypt(char const *fin, char const *fout, std::string const &key, bool const encrypting)
+{
+
+    // (i) Put pipes between the coroutine and the files, as if the data came
+    // from and went to other processes. One thread pumps the input file in
+    // to a pipe and another drains the other pipe in to the output file
+    int inPipe[2];
+    int outPipe[2];
+    if (::pipe(inPipe) != 0 || ::pipe(outPipe) != 0) {
+        std::cout<<"Unable to create pipes"<<std::endl;
+        return;
+    }
+    std::thread feeder([fin, &inPipe]() {
+        std::ifstream inFile(fin, std::ios::in | std::ios::binary);
+        char buffer[4096];
+        while (inFile.read(buffer, sizeof(buffer)) || inFile.gcount() > 0) {
+            for (std::streamsize written = 0; written < inFile.gcount(); ) {
+                ssize_t const put = ::write(inPipe[1], buffer + written, inFile.gcount() - written);
+                if (put < 0) {
+                    break;
+                }
+                written += put;
+            }
+        }
+        ::close(inPipe[1]);
+    });
+    std::thread drainer([fout, &outPipe]() {
+        std::ofstream testOutput(fout, std::ios::out | std::ios::binary);
+        char buffer[4096];
+        ssize_t got;
+        while ((got = ::read(outPipe[0], buffer, sizeof(buffer))) > 0) {
+            testOutput.write(buffer, got);
+        }
+        ::close(outPipe[0]);
+    });
+
+    // (ii) Set up the encryption algorithm that we wish to use
+    EncryptionSink::SharedEncryptor enc;
+    if (encrypting) {
+        enc = boost::make_shared<XTEAEncryptor>(key, 64);
+    } else {
+        enc = boost::make_shared<XTEADecryptor>(key, 64);
+    }
+
+    // (iii) Run the coroutine on a single threaded epoll loop and wait for it
+    EpollAsyncIO io;
+    syncWait(io, asyncCrypt(io, inPipe[0], outPipe[1], enc));
+
+    ::close(inPipe[0]);
+    ::close(outPipe[1]);
+    feeder.join();
+    drainer.join();
+}
+
+void fanOut(char const *fin, char const *fouts, std::string const &key)
+{
+
+    // (i) Create the input stream and one output stream for each of the
+    // comma separated output files
+    std::ifstream inFile(fin, std::ios::in | std::ios::binary);
+    std::vector<boost::shared_ptr<std::ofstream> > outFiles;
+    std::vector<FanOutSink::Destination> destinations;
+    std::istringstream names(fouts);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        outFiles.push_back(boost::make_shared<std::ofstream>(name.c_str(), std::ios::out | std::ios::binary));
+        destinations.push_back(FanOutSink::toStream(*outFiles.back()));
+    }
+
+    // (ii) Set up the encryption algorithm that we wish to use
+    EncryptionSink::SharedEncryptor enc = boost::make_shared<XTEAEncryptor>(key, 64);
+
+    // (iii) Create the fan out sink and make a stream out of it
+    FanOutSink sink(destinations, getStreamSize(inFile), enc);
+    boost::iostreams::stream<FanOutSink> cipherStream(sink);
+
+    // (iv) Copy the input stream to the cipher stream. The data is encrypted
+    // once and written to every output file
+    boost::iostreams::copy(inFile, cipherStream);
+}
+
+void rekeyFile(char const *fin, char const *fout, std::string const &oldKey, std::string const &newKey,
+               bool const toXXTEA)
+{
+
+    // (i) Create the input and output streams
+    std::ifstream inFile(fin, std::ios::in | std::ios::binary);
+    std::ofstream testOutput(fout, std::ios::out | std::ios::binary);
+
+    // (ii) Re-encrypt the XTEA ciphertext in a single pass, either under a
+    // new XTEA key a chunk of blocks at a time, or with XXTEA by chaining a
+    // decryptor to an encryptor. Either way no plaintext is written out
+    if (toXXTEA) {
+        rekey(inFile, testOutput,
+              boost::make_shared<XTEADecryptor>(oldKey, 64),
+              boost::make_shared<XXTEAEncryptor>(newKey, 64 * 1024));
+    } else {
+        rekeyXTEA(inFile, testOutput,
+                  boost::make_shared<XTEAKeySchedule>(oldKey, 64),
+                  boost::make_shared<XTEAKeySchedule>(newKey, 64));
+    }
+}
+
 int main(int argc, char **argv)
 {
 
@@ -96,6 +278,24 @@ int main(int argc, char **argv)
         encrypt(argv[2], argv[3], argv[4]);
     } else if(str=="d") {
         decrypt(argv[2], argv[3], argv[4]);
+    } else if(str=="a") {
+        append(argv[2], argv[3], argv[4]);
+    } else if(str=="xe") {
+        xxtea(argv[2], argv[3], argv[4], true);
+    } else if(str=="xd") {
+        xxtea(argv[2], argv[3], argv[4], false);
+    } else if(str=="ae") {
+        asyncEncryptOrDecrypt(argv[2], argv[3], argv[4], true);
+    } else if(str=="ad") {
+        asyncEncryptOrDecrypt(argv[2], argv[3], argv[4], false);
+    } else if(str=="pe") {
+        pipedEncryptOrDecrypt(argv[2], argv[3], argv[4], true);
+    } else if(str=="pd") {
+        pipedEncryptOrDecrypt(argv[2], argv[3], argv[4], false);
+    } else if(str=="f") {
+        fanOut(argv[2], argv[3], argv[4]);
+    } else if((str=="r" || str=="rx") && argc > 5) {
+        rekeyFile(argv[2], argv[3], argv[4], argv[5], str=="rx");
     }
     return 0;
 }